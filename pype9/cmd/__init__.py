@@ -1,4 +1,5 @@
 from . import convert
 from . import simulate
 from . import plot
+from . import benchmark
 from . import help  # @ReservedAssignment
@@ -0,0 +1,312 @@
+"""
+Benchmarks the performance of Pype9 on a standard set of workloads, so that
+changes in performance between versions of Pype9 (or of the simulator
+backends) can be tracked. The workloads are
+
+    cells
+        single Izhikevich and Hodgkin-Huxley cells
+    brunel
+        the Brunel (2000) network (see examples/api/brunel.py) at each of the
+        orders given by '--brunel_orders'
+    hh
+        an unconnected population of Hodgkin-Huxley cells of each of the sizes
+        given by '--hh_sizes'
+
+which are run for each combination of simulator backend, number of MPI
+processes and threads per process, e.g.::
+
+    $ pype9 benchmark nest neuron --brunel_orders 10 100 \\
+      --num_processes 1 2 4 --num_threads 1 2 --save pype9-0.2.json
+
+Each configuration is run in a separate process (under 'mpirun' when run on
+more than one MPI process) and the time taken to build the cell classes, to
+construct the cells/network and to simulate each second of biological time,
+along with the peak memory of each rank, are saved to a JSON file.
+"""
+from __future__ import division
+from builtins import next
+import os
+import sys
+import json
+import time
+import platform
+import tempfile
+import subprocess
+from argparse import ArgumentParser, SUPPRESS
+from pype9.simulate.common.code_gen import BaseCodeGenerator
+from pype9.utils.logging import logger
+
+BENCHMARKS = ('cells', 'brunel', 'hh')
+
+# The component classes, properties, initial states and regimes of the single
+# cell benchmarks
+CELL_MODELS = {
+    'izhikevich': ('neuron/Izhikevich#IzhikevichFastSpiking',
+                   'neuron/Izhikevich#SampleIzhikevichFastSpiking',
+                   {'U': (-1.625, 'pA'), 'V': (-65.0, 'mV')}, 'subVb'),
+    'hh': ('neuron/HodgkinHuxley#PyNNHodgkinHuxley',
+           'neuron/HodgkinHuxley#PyNNHodgkinHuxleyProperties',
+           {'v': (-65.0, 'mV'), 'm': (0.0, None), 'h': (1.0, None),
+            'n': (0.0, None)}, None)}
+
+
+def argparser():
+    parser = ArgumentParser(prog='pype9 benchmark',
+                            description=__doc__)
+    parser.add_argument('simulators', choices=('neuron', 'nest'), type=str,
+                        nargs='+', help="Which simulator backends to benchmark")
+    parser.add_argument('--benchmarks', choices=BENCHMARKS, type=str,
+                        nargs='+', default=list(BENCHMARKS),
+                        help="Which benchmarks to run (default all)")
+    parser.add_argument('--brunel_orders', type=int, nargs='+',
+                        default=[10, 50, 100],
+                        help=("The orders (size of the inhibitory population) "
+                              "of the Brunel networks to benchmark (default "
+                              "%(default)s)"))
+    parser.add_argument('--hh_sizes', type=int, nargs='+', default=[1000],
+                        help=("The sizes of the Hodgkin-Huxley populations to "
+                              "benchmark (default %(default)s)"))
+    parser.add_argument('--num_processes', type=int, nargs='+', default=[1],
+                        help=("The numbers of MPI processes to benchmark with "
+                              "(default %(default)s)"))
+    parser.add_argument('--num_threads', type=int, nargs='+', default=[1],
+                        help=("The numbers of threads per process to "
+                              "benchmark with (default %(default)s)"))
+    parser.add_argument('--simtime', type=float, default=1000.0,
+                        help=("The length of each simulation in ms (default "
+                              "%(default)s)"))
+    parser.add_argument('--timestep', type=float, default=0.1,
+                        help="The simulation timestep in ms (default "
+                        "%(default)s)")
+    parser.add_argument('--seed', type=int, default=None,
+                        help="Random seed passed to the simulations")
+    parser.add_argument('--build_mode', type=str, default='force',
+                        help=("The build mode used to build the cell classes. "
+                              "By default they are always rebuilt so the "
+                              "build time is measured. Can be one of '{}' "
+                              "(default %(default)s)".format("', '".join(
+                                  BaseCodeGenerator.BUILD_MODE_OPTIONS))))
+    parser.add_argument('--mpirun', type=str, default='mpirun',
+                        help=("The command used to launch the configurations "
+                              "run on more than one MPI process (default "
+                              "%(default)s)"))
+    parser.add_argument('--save', type=str, default='pype9-benchmark.json',
+                        help=("The path of the JSON file to save the results "
+                              "to (default %(default)s)"))
+    # Used internally to run each configuration in a separate process
+    parser.add_argument('--worker', type=str, default=None, help=SUPPRESS)
+    parser.add_argument('--worker_output', type=str, default=None,
+                        help=SUPPRESS)
+    return parser
+
+
+def run(argv):
+    """
+    Runs the benchmarks from the provided arguments
+    """
+    import pype9
+
+    args = argparser().parse_args(argv)
+
+    if args.worker is not None:
+        _run_worker(json.loads(args.worker), args.worker_output)
+        return
+
+    models = {'cells': sorted(CELL_MODELS),
+              'brunel': args.brunel_orders,
+              'hh': args.hh_sizes}
+    results = []
+    for simulator in args.simulators:
+        for benchmark in args.benchmarks:
+            for model in models[benchmark]:
+                for num_processes in args.num_processes:
+                    for num_threads in args.num_threads:
+                        config = {
+                            'benchmark': benchmark, 'model': model,
+                            'simulator': simulator,
+                            'num_processes': num_processes,
+                            'num_threads': num_threads,
+                            'simtime': args.simtime,
+                            'timestep': args.timestep, 'seed': args.seed,
+                            'build_mode': args.build_mode}
+                        logger.info(
+                            "Benchmarking '{}' ({}) on {} with {} process(es)"
+                            " and {} thread(s) per process".format(
+                                benchmark, model, simulator, num_processes,
+                                num_threads))
+                        results.append(_launch(config, args.mpirun))
+    with open(args.save, 'w') as f:
+        json.dump({'pype9_version': pype9.__version__,
+                   'python_version': platform.python_version(),
+                   'platform': platform.platform(),
+                   'date': time.strftime('%Y-%m-%dT%H:%M:%S'),
+                   'results': results}, f, indent=2)
+    logger.info("Saved benchmark results to '{}'".format(args.save))
+
+
+def _launch(config, mpirun):
+    """
+    Runs a benchmark configuration in a separate process so the memory used by
+    each configuration is measured independently
+    """
+    fd, output = tempfile.mkstemp(suffix='.json')
+    os.close(fd)
+    cmd = [sys.executable, '-m', 'pype9.cmd.benchmark',
+           '--worker', json.dumps(config), '--worker_output', output]
+    if config['num_processes'] > 1:
+        cmd = [mpirun, '-np', str(config['num_processes'])] + cmd
+    try:
+        subprocess.check_call(cmd)
+        with open(output) as f:
+            result = json.load(f)
+    except (subprocess.CalledProcessError, OSError, ValueError) as e:
+        # Keep going with the remaining configurations
+        logger.error("Benchmark failed ({}): {}".format(e, ' '.join(cmd)))
+        result = dict(config, error=str(e))
+    finally:
+        os.remove(output)
+    return result
+
+
+def _run_worker(config, output):
+    """
+    Runs a single configuration of a benchmark and writes the results to the
+    output file (from the master node)
+    """
+    import resource
+    from nineml import units as un
+    from pype9.utils.mpi import mpi_comm, is_mpi_master
+
+    if config['simulator'] == 'neuron':
+        from pype9.simulate.neuron import Network, CellMetaClass, Simulation  # @UnusedImport @IgnorePep8
+        import neuron
+        simulator_version = neuron.__version__
+    elif config['simulator'] == 'nest':
+        from pype9.simulate.nest import Network, CellMetaClass, Simulation  # @Reimport @IgnorePep8
+        import nest
+        simulator_version = nest.version()
+    else:
+        assert False
+
+    simtime = config['simtime'] * un.ms
+    sim_kwargs = {'dt': config['timestep'] * un.ms, 'seed': config['seed'],
+                  'num_threads': config['num_threads']}
+    if config['benchmark'] == 'cells':
+        component_class, props, init_state, init_regime = _cell_model(
+            config['model'])
+        start = time.time()
+        Cell = CellMetaClass(component_class, build_mode=config['build_mode'])
+        build_time = time.time() - start
+        with Simulation(**sim_kwargs) as sim:
+            start = time.time()
+            Cell(props, regime_=init_regime, **init_state)
+            construction_time = time.time() - start
+            start = time.time()
+            sim.run(simtime)
+            run_time = time.time() - start
+        num_cells = 1
+    else:
+        if config['benchmark'] == 'brunel':
+            model = _brunel_model(int(config['model']))
+            sim_kwargs.update(model.delay_limits())
+        else:
+            model = _hh_population(int(config['model']))
+        with Simulation(**sim_kwargs) as sim:
+            mpi_comm.barrier()
+            start = time.time()
+            _build_network(Network, model, config['build_mode'])
+            mpi_comm.barrier()
+            build_time = time.time() - start
+            start = time.time()
+            # The cell classes were built above so are only loaded here
+            Network(model, build_mode='lazy')
+            mpi_comm.barrier()
+            construction_time = time.time() - start
+            start = time.time()
+            sim.run(simtime)
+            mpi_comm.barrier()
+            run_time = time.time() - start
+        num_cells = sum(p.size for p in model.populations)
+    # The peak resident memory of each rank (ru_maxrss is in kB on Linux)
+    memory = mpi_comm.allgather(
+        resource.getrusage(resource.RUSAGE_SELF).ru_maxrss / 1024.0)
+    if is_mpi_master():
+        with open(output, 'w') as f:
+            json.dump(dict(
+                config, simulator_version=simulator_version,
+                num_processes=mpi_comm.size, num_cells=num_cells,
+                build_time=build_time, construction_time=construction_time,
+                run_time=run_time,
+                wall_time_per_second=run_time / (config['simtime'] / 1000.0),
+                memory_per_rank=memory), f)
+
+
+def _cell_model(name):
+    import ninemlcatalog
+    from pype9.utils.units import parse_units
+    class_path, props_path, init_state, init_regime = CELL_MODELS[name]
+    component_class = ninemlcatalog.load(class_path)
+    init_state = dict(
+        (n, (v * parse_units(u) if u is not None else v))
+        for n, (v, u) in init_state.items())
+    if init_regime is None:
+        init_regime = next(component_class.regimes).name
+    return (component_class, ninemlcatalog.load(props_path), init_state,
+            init_regime)
+
+
+def _brunel_model(order, case='AI'):
+    """
+    Loads the Brunel model from the nineml catalog and scales it to the given
+    order (as in examples/api/brunel.py)
+    """
+    import numpy
+    import ninemlcatalog
+    from nineml import units as un, Property
+    model = ninemlcatalog.load('network/Brunel2000/' + case).as_network(
+        'Brunel_{}'.format(case))
+    model = model.clone()
+    scale = order / model.population('Inh').size
+    if scale != 1.0:
+        for pop in model.populations:
+            pop.size = int(numpy.ceil(pop.size * scale))
+        for proj in (model.projection('Excitation'),
+                     model.projection('Inhibition')):
+            props = proj.connectivity.rule_properties
+            number = props.property('number')
+            props.set(Property(
+                number.name,
+                int(numpy.ceil(float(number.value) * scale)) * un.unitless))
+    return model
+
+
+def _hh_population(size):
+    import nineml
+    from nineml import units as un
+    _, props, init_state, init_regime = _cell_model('hh')
+    props = nineml.DynamicsProperties(
+        name='HHPopulationProperties', definition=props,
+        initial_values=dict(
+            (n, (v if isinstance(v, nineml.Quantity) else v * un.unitless))
+            for n, v in init_state.items()),
+        initial_regime=init_regime)
+    return nineml.Network('HHPopulation', populations=[
+        nineml.Population('HH', size, cell=props)])
+
+
+def _build_network(Network, model, build_mode):
+    """
+    Builds the cell classes of the network in a batch as is done by the
+    Network constructor, so the build time can be measured separately
+    """
+    arrays = Network._flatten_to_arrays_and_conns(model.clone())[0]
+    Network.ComponentArrayClass.PyNNCellWrapperMetaClass.build_batch(
+        list(arrays.values()), build_mode=build_mode, build_url=model.url,
+        build_version=model.name)
+
+
+if __name__ == '__main__':
+    # Copy and clear sys.argv as it gets in the way of pyNEST import
+    argv = sys.argv[1:]
+    del sys.argv[1:]
+    run(argv)
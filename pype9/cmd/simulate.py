@@ -21,8 +21,25 @@ Properties, initial values and the initial regime (for single cells) can be
 overridden with the '--prop', '--initial_value' and '--initial_regime'
 respectively and must be provided for every parameter/state-variable if they
 are not in the model description file.
+
+Single cells can also be simulated for each of a table of property sets (e.g.
+for parameter fits) with the '--sweep' option, in which case an independent
+copy of the cell is simulated for each row of the table in a single
+simulation, e.g.::
+
+    $ pype9 simulate my_cell.xml nest 100.0 0.01 \\
+      --record my_event_port ~/my_even_port.neo.pkl \\
+      --sweep my_sweep.csv
+
+The table is a CSV file with a header row of property (or state-variable)
+names, with their units separated by colons (e.g. "tau:ms,v_reset:mV"), and
+a row for each copy of the cell. The recordings are indexed by the rows of
+the table. For NEST sweeps, the '--batched' option builds the cells with the
+batched (structure-of-arrays) update, which steps the ODEs of all the copies
+together.
 """
 from builtins import next
+import csv
 import collections
 from argparse import ArgumentParser
 from nineml import units as un
@@ -33,6 +50,7 @@ from pype9.utils.units import parse_units
 from pype9.utils.logging import logger
 
 RecordSpec = collections.namedtuple('RecordSpec', 'port fname t_start')
+SweepColumn = collections.namedtuple('SweepColumn', 'name units values')
 
 
 def argparser():
@@ -88,6 +106,19 @@ def argparser():
                         help=("The delay applied to signals played into ports "
                               "of the model (only applicable for NEST "
                               "simulations)"))
+    parser.add_argument('--num_threads', type=int, default=1,
+                        help=("The number of threads to run on each MPI "
+                              "process (only applicable for network "
+                              "simulations and sweeps, default %(default)s)"))
+    parser.add_argument('--sweep', type=str, default=None,
+                        help=("Path to a CSV table of property sets. An "
+                              "independent copy of the cell is simulated for "
+                              "each row of the table (only applicable for "
+                              "single cell simulations)"))
+    parser.add_argument('--batched', action='store_true', default=False,
+                        help=("Build the cells of sweeps with the batched "
+                              "(structure-of-arrays) update of NEST models "
+                              "(only applicable for NEST sweeps)"))
     parser.add_argument('--build_mode', type=str, default='lazy',
                         help=("The strategy used to build and compile the "
                               "model. Can be one of '{}' (default %(default)s)"
@@ -165,9 +196,14 @@ def run(argv):
             .format(model))
 
     if isinstance(model, nineml.Network):
+        if args.sweep is not None:
+            raise Pype9UsageError(
+                "Sweeps ('--sweep' option) can only be run over single cell "
+                "models, not the '{}' network".format(model.name))
         with Simulation(dt=timestep, seed=args.seed,
                         properties_seed=args.properties_seed,
                         device_delay=device_delay,
+                        num_threads=args.num_threads,
                         **model.delay_limits()) as sim:
             # Construct the network
             logger.info("Constructing network")
@@ -198,6 +234,10 @@ def run(argv):
         elif isinstance(model, nineml.DynamicsProperties):
             props = model
             component_class = model.component_class
+        elif args.sweep is not None:
+            # The properties are provided by the sweep table
+            props = None
+            component_class = model
         else:
             raise Pype9UsageError(
                 "Specified model {} is not a dynamics properties object and "
@@ -223,6 +263,11 @@ def run(argv):
         for port_name, _ in args.play:
             if component_class.port(port_name).dimension == un.current:
                 external_currents.append(port_name)
+        if args.sweep is not None:
+            run_sweep(args, component_class, props, init_state, init_regime,
+                      record_specs, external_currents, time, timestep,
+                      min_delay, device_delay, Network, Simulation)
+            return
         # Build cell class
         Cell = CellMetaClass(component_class,
                              build_mode=args.build_mode,
@@ -278,3 +323,134 @@ def run(argv):
         for fname, data_seg in data_segs.items():
             neo.io.PickleIO(fname).write(data_seg)
     logger.info("Finished simulation of '{}' for {}".format(model.name, time))
+
+
+def run_sweep(args, component_class, props, init_state, init_regime,
+              record_specs, external_currents, time, timestep, min_delay,
+              device_delay, Network, Simulation):
+    """
+    Simulates an independent copy of the cell for each row of the sweep table
+    in a single simulation, using a component array with the properties of
+    each row set on its cells
+    """
+    import numpy
+    import nineml
+    import neo.io
+    from pype9.exceptions import Pype9UsageError
+
+    sweep = read_sweep_table(args.sweep)
+    num_rows = len(sweep[0].values)
+    # The properties and initial values of the first row are used as the
+    # defaults of the array
+    properties = (dict((p.name, p.quantity) for p in props.properties)
+                  if props is not None else {})
+    initial_values = dict(init_state)
+    for col in sweep:
+        if col.name in component_class.state_variable_names:
+            initial_values[col.name] = col.values[0] * col.units
+        elif col.name in component_class.parameter_names:
+            properties[col.name] = col.values[0] * col.units
+        else:
+            raise Pype9UsageError(
+                "'{}' column of sweep table '{}' is not a property or state "
+                "variable of '{}'".format(col.name, args.sweep,
+                                          component_class.name))
+    array_props = nineml.DynamicsProperties(
+        component_class.name + '_sweep', component_class, properties,
+        initial_values=initial_values, initial_regime=init_regime)
+    build_kwargs = {}
+    build_version = args.build_version
+    if args.batched:
+        if args.simulator == 'nest':
+            # Step the ODEs of all the copies together in structure-of-arrays
+            # form, under a different build version so unbatched builds are
+            # not reused
+            build_kwargs['batched'] = True
+            build_version = (build_version or '') + 'Batched'
+        else:
+            logger.warning(
+                "Batched builds are only available for NEST, ignoring "
+                "'--batched' option for {} sweep".format(args.simulator))
+    with Simulation(dt=timestep, seed=args.seed, min_delay=min_delay,
+                    device_delay=device_delay, num_threads=args.num_threads,
+                    build_base_dir=args.build_dir) as sim:
+        logger.info("Constructing {} copies of '{}' for sweep '{}'".format(
+            num_rows, component_class.name, args.sweep))
+        array = Network.ComponentArrayClass(
+            nineml.ComponentArray(component_class.name + 'Sweep', num_rows,
+                                  array_props),
+            build_mode=args.build_mode, build_version=build_version,
+            build_base_dir=args.build_dir,
+            external_currents=external_currents, **build_kwargs)
+        # Set the properties and initial values of each row on its cell
+        params = {}
+        inits = {}
+        for col in sweep:
+            values = (numpy.asarray(col.values) *
+                      array.UnitHandler.scalar(col.units))
+            if col.name in component_class.state_variable_names:
+                inits[col.name] = values
+            else:
+                params[col.name] = values
+        if params:
+            array.set(**params)
+        if inits:
+            array.initialize(**inits)
+        # Play the same inputs into every copy
+        for port_name, fname in args.play:
+            seg = neo.io.PickleIO(filename=fname).read()[0]
+            if component_class.receive_port(port_name).communicates == 'event':
+                signal = seg.spiketrains[0]
+            else:
+                signal = seg.analogsignals[0]
+            array.play(port_name, signal)
+        for rspec in record_specs:
+            array.record(rspec.port)
+        logger.info("Running the simulation")
+        sim.run(time)
+    logger.info("Writing recorded data to file")
+    for rspec in record_specs:
+        seg = array.recording(rspec.port, t_start=rspec.t_start)
+        seg.annotate(sweep_table=args.sweep)
+        neo.io.PickleIO(rspec.fname).write(seg)
+    logger.info("Finished sweep of '{}' over {} property sets for {}".format(
+        component_class.name, num_rows, time))
+
+
+def read_sweep_table(path):
+    """
+    Reads a table of property sets from a CSV file with a header row of
+    property (or state-variable) names and their units separated by colons,
+    e.g. "tau:ms", and a row of values for each property set
+
+    Parameters
+    ----------
+    path : str
+        Path to the CSV file
+
+    Returns
+    -------
+    columns : list(SweepColumn)
+        The name, units and values of each column of the table
+    """
+    from nineml import units as un
+    from pype9.exceptions import Pype9UsageError
+    with open(path) as f:
+        rows = [r for r in csv.reader(f) if r]
+    if len(rows) < 2:
+        raise Pype9UsageError(
+            "Sweep table '{}' needs a header row and at least one row of "
+            "values".format(path))
+    columns = []
+    for i, heading in enumerate(rows[0]):
+        name, _, units = heading.strip().partition(':')
+        try:
+            values = [float(r[i]) for r in rows[1:]]
+        except (IndexError, ValueError):
+            raise Pype9UsageError(
+                "Missing or non-numeric values in '{}' column of sweep table "
+                "'{}'".format(name, path))
+        columns.append(SweepColumn(
+            name, parse_units(units.strip()) if units else un.unitless,
+            values))
+    return columns
@@ -58,28 +58,11 @@ class CellMetaClass(type):
     def __new__(cls, component_class, build_url=None, build_version=None,
                 build_base_dir=None, code_generator=None, build_mode='lazy',
                 **kwargs):
-        # Grab the url before the component class is cloned
-        url = (build_url if build_url is not None else component_class.url)
-        # Clone component class so annotations can be added to it and not bleed
-        # into the calling code.
-        component_class = component_class.clone()
-        # If the component class is not already wrapped in a WithSynapses
-        # object, wrap it in one before passing to the code template generator
-        if not isinstance(component_class, WithSynapses):
-            component_class = WithSynapses.wrap(component_class)
-        # Extract name from component class and append build_version if
-        # provided
-        name = component_class.name + BUILD_NAME_SUFFIX
-        if build_version is not None:
-            name += build_version
-        if code_generator is None:
-            try:
-                code_generator = cls.Simulation.active().code_generator
-            except Pype9NoActiveSimulationError:
-                code_generator = cls.CodeGenerator(base_dir=build_base_dir)
-        # Get transformed build class
-        build_component_class = code_generator.transform_for_build(
-            name=name, component_class=component_class, **kwargs)
+        (component_class, build_component_class, name, url,
+         code_generator) = cls._prepare_build(
+            component_class, build_url=build_url, build_version=build_version,
+            build_base_dir=build_base_dir, code_generator=code_generator,
+            **kwargs)
         try:
             Cell = cls._built_types[name]
         except KeyError:
@@ -112,16 +95,25 @@ class CellMetaClass(type):
                                 annotations_ns=[PYPE9_NS])))
             build = False
         if build:
-            # Only build the components on the root node
-            if is_mpi_master():
-                # Generate and compile cell class
-                code_generator.generate(component_class=build_component_class,
-                                        url=url, build_mode=build_mode,
-                                        **kwargs)
-            # Make slave nodes wait for the root node to finish building
-            mpi_comm.barrier()
-            # Load newly built model
-            code_generator.load_libraries(name, url)
+            # Cell classes that were built and loaded as part of a batch (see
+            # build_batch) only need their Python classes to be created
+            if not code_generator.was_batch_built(build_component_class):
+                # Only build the components on the root node
+                if is_mpi_master():
+                    # Generate and compile cell class
+                    code_generator.generate(
+                        component_class=build_component_class, url=url,
+                        build_mode=build_mode, **kwargs)
+                # Make slave nodes wait for the root node to finish building
+                mpi_comm.barrier()
+                # Copy the build published by the root node into the local
+                # build directory of the slave nodes (if the build cache is
+                # enabled and the build directory isn't shared)
+                if not is_mpi_master():
+                    code_generator.restore_from_cache(build_component_class,
+                                                      url=url, **kwargs)
+                # Load newly built model
+                code_generator.load_libraries(name, url)
             # Create class member dict of new class
             dct = {'name': name,
                    'component_class': component_class,
@@ -136,6 +128,92 @@ class CellMetaClass(type):
             cls._built_types[name] = Cell
         return Cell
 
+    @classmethod
+    def build_batch(cls, builds, build_mode='lazy'):
+        """
+        Generates and builds several cell classes together into a single
+        simulator library (see CodeGenerator.generate_batch), which is loaded
+        once. Subsequently constructing the cell classes with the same
+        arguments reuses the batch build.
+
+        Parameters
+        ----------
+        builds : list(dict)
+            The keyword arguments that the cell classes will be constructed
+            with (other than 'build_mode')
+        build_mode : str
+            The build mode (see CodeGenerator.generate)
+        """
+        prepared = []
+        for build_kwargs in builds:
+            build_kwargs = dict(build_kwargs)
+            build_kwargs.pop('build_mode', None)
+            component_class = build_kwargs.pop('component_class')
+            (_, build_component_class, name, url,
+             code_generator) = cls._prepare_build(component_class,
+                                                  **build_kwargs)
+            # Cell classes that have already been loaded are skipped
+            if name in cls._built_types or any(
+                    name == p[0].name for p in prepared):
+                continue
+            for k in ('build_url', 'build_version', 'build_base_dir',
+                      'code_generator'):
+                build_kwargs.pop(k, None)
+            prepared.append((build_component_class, url, build_kwargs,
+                             code_generator))
+        # There is nothing to gain from batching a single class
+        if len(prepared) < 2:
+            return
+        code_generator = prepared[0][3]
+        if any(p[3] != code_generator for p in prepared[1:]):
+            raise Pype9UsageError(
+                "Cannot build cell classes with different code generators "
+                "in the same batch")
+        batch = [p[:3] for p in prepared]
+        # Only build the batch on the root node
+        if is_mpi_master():
+            name = code_generator.generate_batch(batch, build_mode=build_mode)
+        # Make slave nodes wait for the root node to finish building
+        mpi_comm.barrier()
+        if not is_mpi_master():
+            name = code_generator.batch_name(p[0] for p in batch)
+            code_generator.restore_build(name, None,
+                                         code_generator.batch_key(batch))
+        code_generator.load_batch(name, batch)
+
+    @classmethod
+    def _prepare_build(cls, component_class, build_url=None,
+                       build_version=None, build_base_dir=None,
+                       code_generator=None, **kwargs):
+        """
+        Transforms the component class into the build component class and
+        determines its build name, URL and code generator
+        """
+        # Grab the url before the component class is cloned
+        url = (build_url if build_url is not None else component_class.url)
+        # Clone component class so annotations can be added to it and not bleed
+        # into the calling code.
+        component_class = component_class.clone()
+        # If the component class is not already wrapped in a WithSynapses
+        # object, wrap it in one before passing to the code template generator
+        if not isinstance(component_class, WithSynapses):
+            component_class = WithSynapses.wrap(component_class)
+        # Extract name from component class and append build_version if
+        # provided
+        name = component_class.name + BUILD_NAME_SUFFIX
+        if build_version is not None:
+            name += build_version
+        if code_generator is None:
+            try:
+                code_generator = cls.Simulation.active().code_generator
+            except Pype9NoActiveSimulationError:
+                code_generator = cls.CodeGenerator(base_dir=build_base_dir)
+        # Get transformed build class
+        build_component_class = code_generator.transform_for_build(
+            name=name, component_class=component_class, **kwargs)
+        return (component_class, build_component_class, name, url,
+                code_generator)
+
     def __init__(self, component_class, **kwargs):
         # This initializer is empty, but since I have changed the signature of
         # the __new__ method in the deriving metaclasses it complains otherwise
@@ -481,26 +559,36 @@ class Cell(object):
     def _regime_recording(self):
         raise NotImplementedError("Should be implemented by derived class")
 
+    def _regime_transitions(self):
+        """
+        Returns the times the regime changed (starting with the start of the
+        recording), the indices of the regimes it changed to and the end of
+        the recording. Derived from the recorded regime trace unless
+        overridden by derived classes that log the transitions directly
+        """
+        rec = self._regime_recording()
+        trans_inds = np.nonzero(
+            np.asarray(rec[1:]) != np.asarray(rec[:-1]))[0] + 1
+        # Insert initial regime
+        trans_inds = np.insert(trans_inds, 0, 0)
+        return (rec.times[trans_inds],
+                [int(rec[int(i)]) for i in trans_inds], rec.t_stop)
+
     def regime_epochs(self):
         """
         Retrieves the periods spent in each regime during the simulation
         in a neo.core.EpochArray
         """
         try:
-            rec = self._regime_recording()
+            times, indices, t_stop = self._regime_transitions()
         except KeyError:
             raise Pype9RegimeTransitionsNotRecordedError(
                 "Regime transitions not recorded, call 'record_regime' before"
                 " simulation")
         cc = self.build_component_class
         index_map = dict((cc.index_of(r), r.name) for r in cc.regimes)
-        trans_inds = np.nonzero(
-            np.asarray(rec[1:]) != np.asarray(rec[:-1]))[0] + 1
-        # Insert initial regime
-        trans_inds = np.insert(trans_inds, 0, 0)
-        labels = [index_map[int(rec[int(i)])] for i in trans_inds]
-        times = rec.times[trans_inds]
-        epochs = np.append(times, rec.t_stop) * times.units
+        labels = [index_map[int(i)] for i in indices]
+        epochs = np.append(times, t_stop.rescale(times.units)) * times.units
         durations = epochs[1:] - epochs[:-1]
         return neo.Epoch(
             times=times, durations=durations, labels=labels,
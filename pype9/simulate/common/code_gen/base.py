@@ -16,6 +16,8 @@ import platform
 import os
 import subprocess as sp
 import time
+import hashlib
+import json
 from itertools import chain
 from copy import deepcopy
 import shutil
@@ -36,7 +38,7 @@ import re
 from nineml.serialization import url_re
 import sysconfig
 from pype9 import __version__
-from pype9.utils.paths import remove_ignore_missing
+from pype9.utils.paths import remove_ignore_missing, copytree_atomic
 from pype9.utils.logging import logger
 
 BASE_BUILD_DIR = os.path.join(
@@ -46,6 +48,10 @@ BASE_BUILD_DIR = os.path.join(
     'v{}'.format(__version__),
     'python{}'.format(sysconfig.get_config_var('py_version')))
 
+# Environment variable used to set the shared build cache directory when it
+# isn't passed to the code generator explicitly
+BUILD_CACHE_ENV_VAR = 'PYPE9_BUILD_CACHE'
+
 
 class BaseCodeGenerator(with_metaclass(ABCMeta, object)):
     """
@@ -54,6 +60,13 @@ class BaseCodeGenerator(with_metaclass(ABCMeta, object)):
         base_dir : str | None
             The base directory for the generated code. If None a directory
             will be created in user's home directory.
+        cache_dir : str | None
+            A (potentially shared) directory in which built modules are
+            published under a hash of everything that determines the build
+            products, so that other processes and hosts can reuse them
+            instead of building them again. If None it is read from the
+            PYPE9_BUILD_CACHE environment variable, and if that isn't set
+            the cache is disabled.
     """
 
     BUILD_MODE_OPTIONS = ['lazy',  # Build iff source has been updated
@@ -64,11 +77,19 @@ class BaseCodeGenerator(with_metaclass(ABCMeta, object)):
                           'purge'  # Remove all configure files and rebuild
                           ]
 
+    # Optimisation profiles of the compiled code. 'release' uses the
+    # simulator's own flags, 'debug' disables optimisation, 'native' targets
+    # the instruction set of the build machine with link-time optimisation
+    # and 'pgo' additionally uses a profile recorded by a training run.
+    BUILD_PROFILES = ('debug', 'release', 'native', 'pgo')
+    BUILD_PROFILE_DEFAULT = 'release'
+
     _PARAMS_DIR = 'params'
     _SRC_DIR = 'src'
     _INSTL_DIR = 'install'
     _CMPL_DIR = 'compile'  # Ignored for NEURON but used for NEST
     _BUILT_COMP_CLASS = 'built_component_class.xml'
+    _BUILD_KEY = 'build_key'
 
     # Python functions and annotations to be made available in the templates
     _globals = dict(
@@ -84,11 +105,21 @@ class BaseCodeGenerator(with_metaclass(ABCMeta, object)):
     # units
     DEFAULT_UNITS = {}
 
-    def __init__(self, base_dir=None, **kwargs):  # @UnusedVariable
+    def __init__(self, base_dir=None, cache_dir=None, **kwargs):  # @UnusedVariable @IgnorePep8
         if base_dir is None:
             base_dir = BASE_BUILD_DIR
         self._base_dir = os.path.join(
             base_dir, self.SIMULATOR_NAME + self.SIMULATOR_VERSION)
+        if cache_dir is None:
+            cache_dir = os.environ.get(BUILD_CACHE_ENV_VAR, None)
+        if cache_dir is not None:
+            cache_dir = os.path.join(
+                os.path.abspath(expanduser(cache_dir)),
+                self.SIMULATOR_NAME + self.SIMULATOR_VERSION)
+        self._cache_dir = cache_dir
+        self._templates_digest = None
+        self._compiler_version = None
+        self._batch_built = {}
 
     def __repr__(self):
         return "{}CodeGenerator(base_dir='{}')".format(
@@ -108,6 +139,55 @@ class BaseCodeGenerator(with_metaclass(ABCMeta, object)):
     def base_dir(self):
         return self._base_dir
 
+    @property
+    def cache_dir(self):
+        return self._cache_dir
+
+    @property
+    def compiler_version(self):
+        """
+        A string identifying the compiler used to build the generated code,
+        which is included in the build cache key
+        """
+        if self._compiler_version is None:
+            compiler = self.get_compiler()
+            if compiler is None:
+                self._compiler_version = ''
+            else:
+                stdout, _ = self.run_command(
+                    compiler.split() + ['--version'],
+                    fail_msg=("Could not run compiler '{}': {{}}"
+                              .format(compiler)))
+                self._compiler_version = compiler + '\n' + stdout.strip()
+        return self._compiler_version
+
+    @property
+    def host_processor(self):
+        """
+        A string identifying the processor of the host and the instruction
+        set extensions it supports (which determine the code generated for
+        the 'native' and 'pgo' build profiles)
+        """
+        processor = [platform.machine(), platform.processor()]
+        try:
+            with open('/proc/cpuinfo') as f:
+                for line in f:
+                    key = line.split(':')[0].strip()
+                    if key in ('model name', 'flags', 'Features'):
+                        processor.append(line.strip())
+                    elif not line.strip() and len(processor) > 2:
+                        break  # Only the first processor is needed
+        except IOError:
+            pass
+        return '\n'.join(processor)
+
+    def get_compiler(self):
+        """
+        Returns the command of the compiler used to build the generated code
+        (to be overridden by derived classes)
+        """
+        return None
+
     @abstractmethod
     def generate_source_files(self, dynamics, src_dir, name, **kwargs):
         """
@@ -123,9 +203,18 @@ class BaseCodeGenerator(with_metaclass(ABCMeta, object)):
         pass
 
     @abstractmethod
-    def compile_source_files(self, compile_dir, name):
+    def compile_source_files(self, compile_dir, name, **kwargs):
         pass
 
+    def _build_profile(self, build_profile=None, **kwargs):  # @UnusedVariable @IgnorePep8
+        if build_profile is None:
+            build_profile = self.BUILD_PROFILE_DEFAULT
+        if build_profile not in self.BUILD_PROFILES:
+            raise Pype9BuildError(
+                "Unrecognised build profile '{}', can be one of '{}'"
+                .format(build_profile, "', '".join(self.BUILD_PROFILES)))
+        return build_profile
+
     def generate(self, component_class, build_mode='lazy', url=None, **kwargs):
         """
         Generates and builds the required simulator-specific files for a given
@@ -187,7 +276,9 @@ class BaseCodeGenerator(with_metaclass(ABCMeta, object)):
             compile_source = False
         elif build_mode == 'lazy':  # Generate if source has been modified
             compile_source = True
-            if not os.path.exists(built_comp_class_pth):
+            if self.restore_from_cache(component_class, url=url, **kwargs):
+                generate_source = compile_source = False
+            elif not os.path.exists(built_comp_class_pth):
                 generate_source = True
             else:
                 try:
@@ -241,13 +332,403 @@ class BaseCodeGenerator(with_metaclass(ABCMeta, object)):
                     name=name, src_dir=src_dir, compile_dir=compile_dir,
                     install_dir=install_dir, **kwargs)
                 self.clean_install_dir(install_dir)
-            self.compile_source_files(compile_dir, name)
+            self.compile_source_files(compile_dir, name,
+                                      install_dir=install_dir, **kwargs)
         # Switch back to original dir
         os.chdir(orig_dir)
+        if compile_source:
+            self.publish_to_cache(component_class, url=url, **kwargs)
         # Cache any dimension maps that were calculated during the generation
         # process
         return install_dir
 
+    def generate_batch(self, builds, build_mode='lazy'):
+        """
+        Generates the source files of several component classes into a single
+        source directory and builds them together into one simulator library
+        (i.e. a single NEST extension module or nrnivmodl run), so that they
+        are configured, compiled and loaded once. As the library is configured
+        once, the members must not pass conflicting build options.
+
+        Parameters
+        ----------
+        builds : list(tuple(nineml.Dynamics, str, dict))
+            The transformed build component classes, the URLs they are stored
+            at and the build options (template arguments) for each
+        build_mode : str
+            The build mode (see 'generate'). 'lazy' skips the build if the
+            build key of the batch matches the existing build
+
+        Returns
+        -------
+        name : str
+            The name of the batch, which is passed to 'load_libraries' to
+            load it
+        """
+        name = self.batch_name(cc for cc, _, _ in builds)
+        key = self.batch_key(builds)
+        orig_dir = os.getcwd()
+        src_dir = self.get_source_dir(name, None)
+        compile_dir = self.get_compile_dir(name, None)
+        install_dir = self.get_install_dir(name, None)
+        if build_mode == 'purge':
+            remove_ignore_missing(src_dir)
+            remove_ignore_missing(install_dir)
+            remove_ignore_missing(compile_dir)
+            generate_source = compile_source = True
+        elif build_mode in ('force', 'build_only'):
+            generate_source = compile_source = True
+        elif build_mode == 'require':
+            if not os.path.exists(install_dir):
+                raise Pype9BuildError(
+                    "Prebuilt installation directory '{}' is not "
+                    "present, and is required for  'require' build option"
+                    .format(install_dir))
+            generate_source = compile_source = False
+        elif build_mode == 'generate_only':
+            generate_source = True
+            compile_source = False
+        elif build_mode == 'lazy':
+            if (self.restore_build(name, None, key) or
+                    self.built_key(name, None) == key):
+                generate_source = compile_source = False
+                logger.info("Found existing build of batch '{}' ({}), build "
+                            "skipped".format(name, ', '.join(
+                                cc.name for cc, _, _ in builds)))
+            else:
+                generate_source = compile_source = True
+        else:
+            raise Pype9BuildError(
+                "Unrecognised build option '{}', must be one of ('{}')"
+                .format(build_mode, "', '".join(self.BUILD_MODE_OPTIONS)))
+        component_names = [cc.name for cc, _, _ in builds]
+        batch_kwargs = self._batch_kwargs(builds)
+        if generate_source:
+            # The sources of all the members are generated into the same
+            # directory, so it is only cleaned once (the base implementation
+            # of clean_src_dir removes the whole directory)
+            remove_ignore_missing(src_dir)
+            self.clean_src_dir(src_dir, name)
+            for component_class, _, kwargs in builds:
+                self.generate_source_files(
+                    name=component_class.name,
+                    component_class=component_class,
+                    src_dir=src_dir,
+                    compile_dir=compile_dir,
+                    install_dir=install_dir,
+                    module_name=name,
+                    **kwargs)
+            self.generate_module_files(name, component_names, src_dir)
+        if compile_source:
+            self.clean_compile_dir(compile_dir, purge=(build_mode == 'purge'))
+            self.configure_build_files(
+                name=name, src_dir=src_dir, compile_dir=compile_dir,
+                install_dir=install_dir, component_names=component_names,
+                **batch_kwargs)
+            self.clean_install_dir(install_dir)
+            self.compile_source_files(
+                compile_dir, name, install_dir=install_dir,
+                component_names=component_names, **batch_kwargs)
+        os.chdir(orig_dir)
+        if compile_source:
+            self.publish_build(name, None, key)
+        return name
+
+    def _batch_kwargs(self, builds):
+        """
+        Combines the build options of the members of a batch, which the build
+        files of the batch are configured with
+
+        Parameters
+        ----------
+        builds : list(tuple(nineml.Dynamics, str, dict))
+            The members of the batch (see 'generate_batch')
+
+        Returns
+        -------
+        batch_kwargs : dict
+            The union of the build options of the members
+        """
+        batch_kwargs = {}
+        owners = {}
+        for component_class, _, kwargs in builds:
+            for key, value in kwargs.items():
+                if key in batch_kwargs and batch_kwargs[key] != value:
+                    raise Pype9BuildError(
+                        "Cannot build '{}' and '{}' in the same batch as they "
+                        "have conflicting values for the '{}' build option "
+                        "({} and {}), build them separately instead (e.g. "
+                        "with batch_build=False)"
+                        .format(owners[key], component_class.name, key,
+                                batch_kwargs[key], value))
+                batch_kwargs[key] = value
+                owners[key] = component_class.name
+        return batch_kwargs
+
+    def generate_module_files(self, name, component_names, src_dir):
+        """
+        Generates the files that register the component classes of a batch
+        with the simulator (to be overridden by derived classes if required)
+        """
+        pass
+
+    def load_batch(self, name, builds):
+        """
+        Loads the library built by 'generate_batch' and records the build
+        component classes it contains so that they aren't built and loaded
+        again individually
+
+        Parameters
+        ----------
+        name : str
+            The name of the batch returned by 'generate_batch'
+        builds : list(tuple(nineml.Dynamics, str, dict))
+            The builds passed to 'generate_batch'
+        """
+        self.load_libraries(name, None)
+        for component_class, _, _ in builds:
+            self._batch_built[component_class.name] = component_class
+
+    def was_batch_built(self, component_class):
+        """
+        Whether the build component class has already been built and loaded
+        as part of a batch
+        """
+        try:
+            built = self._batch_built[component_class.name]
+        except KeyError:
+            return False
+        return built.equals(component_class, annotations_ns=[PYPE9_NS])
+
+    def batch_name(self, component_classes):
+        """
+        The name of the batch containing the given component classes, which
+        is derived from their names so that the batch is rebuilt in the same
+        directory when any of them change
+        """
+        names = '\0'.join(sorted(cc.name for cc in component_classes))
+        return 'Batch' + hashlib.sha256(names.encode('utf-8')).hexdigest()[:12]
+
+    def batch_key(self, builds):
+        """
+        The build key of a batch, which combines the build keys of its members
+        """
+        key = hashlib.sha256()
+        for member_key in sorted(self.build_key(cc, **kwargs)
+                                 for cc, _, kwargs in builds):
+            key.update(member_key.encode('utf-8'))
+        return key.hexdigest()
+
+    def build_key(self, component_class, **kwargs):
+        """
+        Returns a hash of everything that determines the build products of a
+        component class: its serialization (including the build properties
+        saved in its annotations), the build options, the template sources,
+        and the versions of PyPe9, the simulator and the compiler.
+
+        Parameters
+        ----------
+        component_class : nineml.Dynamics
+            The transformed build component class
+        kwargs : dict
+            The build options passed to 'generate'
+
+        Returns
+        -------
+        key : str
+            Hexadecimal SHA-256 digest
+        """
+        # The template sources are the same for every build so are only
+        # hashed once
+        if self._templates_digest is None:
+            tmpl_hash = hashlib.sha256()
+            for dpath, dnames, fnames in sorted(os.walk(self.BASE_TMPL_PATH)):
+                dnames.sort()
+                for fname in sorted(fnames):
+                    fpath = os.path.join(dpath, fname)
+                    tmpl_hash.update(os.path.relpath(
+                        fpath, self.BASE_TMPL_PATH).encode('utf-8'))
+                    with open(fpath, 'rb') as f:
+                        tmpl_hash.update(f.read())
+            self._templates_digest = tmpl_hash.hexdigest()
+        # Code built for the instruction set of the build machine can't be
+        # shared with hosts with different processors
+        if self._build_profile(**kwargs) in ('native', 'pgo'):
+            target = self.host_processor
+        else:
+            target = platform.machine()
+        key = hashlib.sha256()
+        for part in (component_class.serialize(format='xml', version=2,
+                                               to_str=True),
+                     json.dumps(kwargs, sort_keys=True,
+                                default=self._build_key_value),
+                     self._templates_digest, __version__,
+                     self.SIMULATOR_NAME, self.SIMULATOR_VERSION,
+                     self.compiler_version, target):
+            key.update(part.encode('utf-8'))
+            key.update(b'\0')
+        return key.hexdigest()
+
+    @classmethod
+    def _build_key_value(cls, value):
+        """
+        Converts build option values that can't be serialized to JSON directly
+        into a canonical form (sets are sorted so that the key doesn't depend
+        on the order in which they are iterated)
+        """
+        if isinstance(value, (set, frozenset)):
+            return sorted(value, key=str)
+        return str(value)
+
+    def get_cache_entry_dir(self, name, key):
+        return os.path.join(self.cache_dir, '{}_{}'.format(name, key))
+
+    def publish_to_cache(self, component_class, url=None, **kwargs):
+        """
+        Publishes the local build of a component class to the build cache (if
+        enabled)
+
+        Parameters
+        ----------
+        component_class : nineml.Dynamics
+            The transformed build component class
+        url : str
+            The URL where the component class is stored (used to form the
+            build path)
+        kwargs : dict
+            The build options passed to 'generate'
+        """
+        if url is None:
+            url = component_class.url
+        self.publish_build(component_class.name, url,
+                           self.build_key(component_class, **kwargs))
+
+    def restore_from_cache(self, component_class, url=None, **kwargs):
+        """
+        Restores a previously published build of a component class from the
+        build cache (if enabled) into the local build directory
+
+        Parameters
+        ----------
+        component_class : nineml.Dynamics
+            The transformed build component class
+        url : str
+            The URL where the component class is stored (used to form the
+            build path)
+        kwargs : dict
+            The build options passed to 'generate'
+
+        Returns
+        -------
+        restored : bool
+            Whether a matching build was found in the cache (or was already
+            present locally)
+        """
+        if self.cache_dir is None:
+            return False
+        if url is None:
+            url = component_class.url
+        return self.restore_build(component_class.name, url,
+                                  self.build_key(component_class, **kwargs))
+
+    def publish_build(self, name, url, key):
+        """
+        Records the key of a completed local build in its build directory and
+        publishes the build to the build cache (if enabled). The entry is a
+        copy of the build directory (without the intermediate compile files),
+        which is renamed into place once complete so that processes reading
+        the cache never see it partially written. As the entries are named
+        by their build keys an existing entry is never replaced.
+
+        Parameters
+        ----------
+        name : str
+            Name of the build (component class or batch)
+        url : str
+            The URL used to form the build path
+        key : str
+            The build key (see 'build_key')
+        """
+        build_dir = os.path.abspath(self.get_build_dir(name, url))
+        with open(os.path.join(build_dir, self._BUILD_KEY), 'w') as f:
+            f.write(key)
+        if self.cache_dir is None:
+            return
+        compile_dir = self.get_compile_dir(name, url)
+        if compile_dir != self.get_source_dir(name, url):
+            def ignore(directory, _):
+                return ([os.path.basename(compile_dir)]
+                        if os.path.abspath(directory) == build_dir else [])
+        else:
+            ignore = None
+        entry_dir = self.get_cache_entry_dir(name, key)
+        if os.path.exists(entry_dir):
+            logger.debug("'{}' is already published to build cache at '{}'"
+                         .format(name, entry_dir))
+            return
+        try:
+            published = copytree_atomic(build_dir, entry_dir, ignore=ignore)
+        except (OSError, shutil.Error) as e:
+            # A failure to publish shouldn't fail the build
+            logger.warning("Could not publish '{}' to build cache at '{}': {}"
+                           .format(name, entry_dir, e))
+        else:
+            if published:
+                logger.info("Published '{}' to build cache at '{}'"
+                            .format(name, entry_dir))
+
+    def restore_build(self, name, url, key):
+        """
+        Restores a build from the build cache (if enabled) into the local
+        build directory, unless the local build already has the same key.
+
+        Parameters
+        ----------
+        name : str
+            Name of the build (component class or batch)
+        url : str
+            The URL used to form the build path
+        key : str
+            The build key (see 'build_key')
+
+        Returns
+        -------
+        restored : bool
+            Whether a matching build was found in the cache (or was already
+            present locally)
+        """
+        if self.cache_dir is None:
+            return False
+        entry_dir = self.get_cache_entry_dir(name, key)
+        if not os.path.exists(entry_dir):
+            return False
+        build_dir = self.get_build_dir(name, url)
+        if self.built_key(name, url) == key:
+            return True
+        try:
+            copytree_atomic(entry_dir, build_dir, marker=self._BUILD_KEY)
+        except (OSError, shutil.Error) as e:
+            logger.warning("Could not restore '{}' from build cache at '{}', "
+                           "building locally instead: {}"
+                           .format(name, entry_dir, e))
+            return False
+        logger.info("Restored '{}' from build cache at '{}' (set "
+                    "'build_mode' argument to 'force' or 'build_only' to "
+                    "enforce rebuilding)".format(name, entry_dir))
+        return True
+
+    def built_key(self, name, url):
+        """
+        Returns the key recorded for the local build, or None if there is no
+        completed local build
+        """
+        try:
+            with open(os.path.join(self.get_build_dir(name, url),
+                                   self._BUILD_KEY)) as f:
+                return f.read()
+        except IOError:
+            return None
+
     def get_build_dir(self, name, url):
         return os.path.join(self.base_dir, self.url_build_path(url), name)
 
@@ -297,7 +778,7 @@ class BaseCodeGenerator(with_metaclass(ABCMeta, object)):
                 "base\" ('build_dir_base'):\n{}".format(install_dir, e))
 
     def render_to_file(self, template, args, filename, directory, switches={},
-                       post_hoc_subs={}):
+                       post_hoc_subs={}, only_if_changed=False):
         # Initialise the template loader to include the flag directories
         template_paths = [
             self.BASE_TMPL_PATH,
@@ -320,8 +801,15 @@ class BaseCodeGenerator(with_metaclass(ABCMeta, object)):
         contents = jinja_env.get_template(template).render(**args)
         for old, new in list(post_hoc_subs.items()):
             contents = contents.replace(old, new)
+        fpath = os.path.join(directory, filename)
+        # Leave the file (and its modification time) untouched if its contents
+        # are unchanged, so build tools don't consider it to be updated
+        if only_if_changed and os.path.exists(fpath):
+            with open(fpath) as f:
+                if f.read() == contents:
+                    return
         # Write the contents to file
-        with open(os.path.join(directory, filename), 'w') as f:
+        with open(fpath, 'w') as f:
             f.write(contents)
 
     def path_to_utility(self, utility_name, env_var='', **kwargs):  # @UnusedVariable @IgnorePep8
@@ -419,6 +907,10 @@ class BaseCodeGenerator(with_metaclass(ABCMeta, object)):
         """
         for k, v in list(build_props.items()) + [
                 ('version', pype9.__version__)]:
+            # Mappings (e.g. 'constant_parameters') are saved in a canonical
+            # string form so that equal mappings give equal annotations
+            if isinstance(v, dict):
+                v = ', '.join('{}={}'.format(n, v[n]) for n in sorted(v))
             component_class.annotations.set((BUILD_PROPS, PYPE9_NS), k, v)
 
     def run_command(self, cmd, fail_msg=None, **kwargs):
@@ -11,12 +11,14 @@ from past.builtins import basestring
 from builtins import object
 from collections import namedtuple, defaultdict
 from itertools import chain
+import numpy as np
 import quantities as pq
 import neo
 from nineml.user import Property
 from pype9.exceptions import Pype9RuntimeError
 from .values import get_pyNN_value
 import os.path
+import json
 import nineml
 from nineml import units as un
 from pyNN.parameters import Sequence
@@ -33,11 +35,15 @@ from nineml.user import (
     Selection as Selection9ML,
     Concatenate as Concatenate9ML)
 from pype9.exceptions import Pype9UnflattenableSynapseException
-from .connectivity import InversePyNNConnectivity
+from .connectivity import InversePyNNConnectivity, ShardedConnections
+from ..recording import StreamedSpikeInput, StreamedAnalogInput
 from ..cells import (
     MultiDynamicsWithSynapsesProperties, ConnectionPropertySet,
     SynapseProperties)
-from pype9.exceptions import Pype9UsageError, Pype9NameError
+from pype9.exceptions import (
+    Pype9UsageError, Pype9NameError, Pype9DimensionError)
+from pype9.utils.mpi import mpi_comm, affinity_order, balanced_placement
+from pype9.utils.logging import logger
 
 
 _REQUIRED_SIM_PARAMS = ['timestep', 'min_delay', 'max_delay', 'temperature']
@@ -57,13 +63,43 @@ class Network(object):
         A 9ML-Python model of a network (or Document containing
         populations and projections for 9MLv1) or a URL referring to a 9ML
         model.
+    build_mode : str
+        The build/compilation strategy for rebuilding the generated code, can
+        be one of 'lazy', 'force', 'build_only', 'require'.
+    batch_build : bool
+        Whether to build the cell classes of all the component arrays together
+        into a single simulator library instead of one at a time
+    load_connections : str | None
+        A directory that connections have been saved to with
+        'save_connections(..., format="npy")', which the connection groups
+        are connected with instead of sampling their connectivity
+    placement : str
+        How the cells of the component arrays are distributed over the MPI
+        processes, either 'round_robin' (the default distribution of the
+        simulator) or 'balanced', in which each process is assigned
+        contiguous blocks of cells so their estimated cost per time step is
+        balanced, with strongly connected arrays placed on the same
+        processes where possible to reduce the volume of spikes exchanged
+        between them. Only supported by simulators that allow cells to be
+        placed on arbitrary processes (currently NEURON with PyNN 0.9.x)
+    cell_costs : dict(str, float) | str | None
+        The relative costs of updating a cell of each component array per
+        time step (e.g. as measured with the counters of instrumented builds
+        or benchmarks), keyed by the names of the arrays or their component
+        classes, or the path to a JSON file containing them. Costs not
+        provided are estimated from the number of state variables and
+        triggers in each regime of the component classes
     """
 
     # Name given to the "cell" component of the cell dynamics + linear synapse
     # dynamics multi-dynamics
     CELL_COMP_NAME = 'cell'
 
-    def __init__(self, nineml_model, build_mode='lazy', **kwargs):
+    PLACEMENT_DEFAULT = 'round_robin'
+
+    def __init__(self, nineml_model, build_mode='lazy', batch_build=True,
+                 load_connections=None, placement=None, cell_costs=None,
+                 **kwargs):
         if isinstance(nineml_model, basestring):
             nineml_model = nineml.read(nineml_model).as_network(
                 name=os.path.splitext(os.path.basename(nineml_model))[0])
@@ -87,9 +123,23 @@ class Network(object):
         # opposed to other networks
         build_url = kwargs.pop('build_url', nineml_model.url)
         build_version = nineml_model.name + kwargs.pop('build_version', '')
+        # Generate the sources of all the cell classes before compiling them
+        # together, so they are configured, compiled and loaded only once
+        if batch_build:
+            self.ComponentArrayClass.PyNNCellWrapperMetaClass.build_batch(
+                list(flat_comp_arrays.values()), build_mode=build_mode,
+                build_url=build_url, build_version=build_version, **kwargs)
+        if placement is None:
+            placement = self.PLACEMENT_DEFAULT
+        self._cell_costs = self._get_cell_costs(flat_comp_arrays, cell_costs)
+        if build_mode != 'build_only':
+            ranks = self._place_component_arrays(
+                placement, flat_comp_arrays, flat_conn_groups)
+        else:
+            ranks = {}
         for name, comp_array in flat_comp_arrays.items():
             self._component_arrays[name] = self.ComponentArrayClass(
-                comp_array, build_mode=build_mode,
+                comp_array, build_mode=build_mode, ranks=ranks.get(name),
                 build_url=build_url, build_version=build_version, **kwargs)
         self._selections = {}
         # Build the PyNN Selections
@@ -107,6 +157,8 @@ class Network(object):
                     "Connections have already been sampled, please reset them"
                     " using 'resample_connectivity' before constructing "
                     "network")
+            if load_connections is not None:
+                saved_connections = ShardedConnections(load_connections)
             self._connection_groups = {}
             for name, conn_group in flat_conn_groups.items():
                 try:
@@ -118,9 +170,133 @@ class Network(object):
                         conn_group.destination.name]
                 except KeyError:
                     destination = self._selections[conn_group.destination.name]
+                if load_connections is not None:
+                    connector = saved_connections.connector(
+                        name, self.ConnectivityClass._pyNN_module)
+                else:
+                    connector = None
                 self._connection_groups[name] = self.ConnectionGroupClass(
-                    conn_group, source=source, destination=destination)
+                    conn_group, source=source, destination=destination,
+                    connector=connector)
             self._finalise_construction()
+            if self.Simulation.active().num_processes() > 1:
+                self._log_placement()
+
+    def placement_report(self):
+        """
+        Reports the distribution of the cells of the component arrays over
+        the MPI processes (needs to be called on all processes)
+
+        Returns
+        -------
+        report : dict
+            The number of cells of each array placed on each process ('cells')
+            and their estimated cost per time step ('costs'), the ratio of
+            the maximum to the mean cost of the processes ('imbalance') and
+            the estimated fraction of the connections of each connection
+            group between cells on different processes
+            ('remote_connection_fractions')
+        """
+        local = dict((a.name, int(np.count_nonzero(a._mask_local)))
+                     for a in self.component_arrays)
+        cells = mpi_comm.allgather(local)
+        costs = [sum(n * self._cell_costs[a] for a, n in c.items())
+                 for c in cells]
+        mean_cost = np.mean(costs)
+        report = {'cells': cells, 'costs': costs,
+                  'imbalance': (max(costs) / mean_cost if mean_cost else 1.0),
+                  'remote_connection_fractions': {}}
+        for conn_grp in self.connection_groups:
+            try:
+                src = np.array([c[conn_grp.pre.name] for c in cells], float)
+                dest = np.array([c[conn_grp.post.name] for c in cells], float)
+            except KeyError:
+                continue  # Connections from/to selections
+            # Assumes that the sources of the connections to each destination
+            # are drawn from the whole source array
+            report['remote_connection_fractions'][conn_grp.name] = (
+                1.0 - np.sum((src / np.sum(src)) * (dest / np.sum(dest))))
+        return report
+
+    def _log_placement(self):
+        report = self.placement_report()
+        if mpi_comm.rank == 0:
+            logger.info(
+                "Placement of cells of '{}' network on processes (imbalance "
+                "{:.3f}):\n{}\nEstimated fractions of remote connections: {}"
+                .format(
+                    self.nineml.name, report['imbalance'], '\n'.join(
+                        "  {}: cost {:.1f} ({})".format(
+                            rank, cost, ', '.join(
+                                '{}: {}'.format(a, n)
+                                for a, n in sorted(cells.items())))
+                        for rank, (cost, cells) in enumerate(zip(
+                            report['costs'], report['cells']))),
+                    ', '.join('{}: {:.3f}'.format(n, f) for n, f in sorted(
+                        report['remote_connection_fractions'].items()))))
+
+    def _place_component_arrays(self, placement, comp_arrays, conn_groups):
+        """
+        Returns the ranks of the processes to place the cells of each
+        component array on, or an empty dictionary for the default placement
+        of the simulator
+        """
+        if placement == 'round_robin':
+            return {}
+        elif placement != 'balanced':
+            raise Pype9UsageError(
+                "Unrecognised placement '{}' (can be either 'round_robin' or "
+                "'balanced')".format(placement))
+        if not self.ComponentArrayClass.SUPPORTS_PLACEMENT:
+            logger.warning(
+                "Cells cannot be placed on specific processes with {} (or "
+                "with this version of PyNN), so the ranks cannot be balanced "
+                "by their cost (using round-robin placement)"
+                .format(self.Simulation.name))
+            return {}
+        affinities = defaultdict(float)
+        for conn_group in conn_groups.values():
+            if isinstance(conn_group.connectivity, InversePyNNConnectivity):
+                continue
+            affinities[(conn_group.source.name,
+                        conn_group.destination.name)] += (
+                conn_group.connectivity.expected_num_connections())
+        order = affinity_order(sorted(comp_arrays), affinities)
+        ranks = balanced_placement(
+            [comp_arrays[n].size for n in order],
+            [self._cell_costs[n] for n in order],
+            self.Simulation.active().num_processes())
+        return dict(zip(order, ranks))
+
+    @classmethod
+    def _get_cell_costs(cls, comp_arrays, cell_costs):
+        if isinstance(cell_costs, basestring):
+            with open(cell_costs) as f:
+                cell_costs = json.load(f)
+        elif cell_costs is None:
+            cell_costs = {}
+        costs = {}
+        for name, comp_array in comp_arrays.items():
+            component_class = comp_array.dynamics_properties.component_class
+            try:
+                costs[name] = float(cell_costs[name])
+            except KeyError:
+                try:
+                    costs[name] = float(cell_costs[component_class.name])
+                except KeyError:
+                    costs[name] = cls._estimate_cell_cost(component_class)
+        return costs
+
+    @classmethod
+    def _estimate_cell_cost(cls, component_class):
+        """
+        Estimates the relative cost of updating a cell of the component class
+        per time step from the number of state variables that are integrated
+        and triggers that are checked, averaged over its regimes
+        """
+        regimes = list(component_class.regimes)
+        return 1.0 + (sum(r.num_time_derivatives + r.num_on_conditions
+                          for r in regimes) / float(len(regimes)))
 
     def _finalise_construction(self):
         """
@@ -220,21 +396,41 @@ class Network(object):
     def selection_names(self):
         return list(self._selections.keys())
 
-    def save_connections(self, output_dir):
+    def save_connections(self, output_dir, format='list'):  # @ReservedAssignment @IgnorePep8
         """
         Saves generated connections to output directory
 
-        @param output_dir:
+        Parameters
+        ----------
+        output_dir : str
+            The directory to save the connections in
+        format : str
+            Either 'list' (the default), in which the connections are gathered
+            to the master process and written as text, or 'npy', in which each
+            process writes the connections to its local cells into binary
+            '.npy' shards (along with a manifest), which can be loaded by
+            passing the directory to the 'load_connections' argument of the
+            network
         """
-        for conn_grp in self.connection_groups.values():
+        to_save = []
+        for conn_grp in self.connection_groups:
             if isinstance(conn_grp.synapse_type,
                           pyNN.standardmodels.synapses.ElectricalSynapse):
-                attributes = 'weight'
+                to_save.append((conn_grp, ['weight']))
             else:
-                attributes = 'all'
-            conn_grp.save(attributes, os.path.join(
-                output_dir, conn_grp.label + '.proj'), format='list',
-                gather=True)
+                to_save.append((conn_grp, ['weight', 'delay']))
+        if format == 'npy':
+            ShardedConnections.save(to_save, output_dir)
+        elif format == 'list':
+            for conn_grp, attributes in to_save:
+                conn_grp.save(
+                    attributes if len(attributes) == 1 else 'all',
+                    os.path.join(output_dir, conn_grp.label + '.proj'),
+                    format='list', gather=True)
+        else:
+            raise Pype9UsageError(
+                "Unrecognised format '{}' to save connections in (can be "
+                "either 'list' or 'npy')".format(format))
 
     def record(self, variable, t_start=None):  # @UnusedVariable
         """
@@ -584,13 +780,26 @@ class ComponentArray(object):
     build_mode : str
         The build/compilation strategy for rebuilding the generated code, can
         be one of 'lazy', 'force', 'build_only', 'require'.
+    ranks : numpy.ndarray(int) | None
+        The ranks of the MPI processes to place each cell of the array on. If
+        None the cells are distributed by the simulator. Only supported if
+        SUPPORTS_PLACEMENT is True
     """
 
-    def __init__(self, nineml_model, build_mode='lazy', **kwargs):
+    # Whether the cells can be placed on arbitrary processes (instead of by
+    # the simulator's own distribution)
+    SUPPORTS_PLACEMENT = False
+
+    def __init__(self, nineml_model, build_mode='lazy', ranks=None, **kwargs):
         if not isinstance(nineml_model, ComponentArray9ML):
             raise Pype9RuntimeError(
                 "Expected a component array, found {}".format(nineml_model))
+        if ranks is not None and not self.SUPPORTS_PLACEMENT:
+            raise Pype9UsageError(
+                "Cells of '{}' cannot be placed on specific processes"
+                .format(nineml_model.name))
         self._nineml = nineml_model
+        self._ranks = ranks
         dynamics_properties = nineml_model.dynamics_properties
         dynamics = dynamics_properties.component_class
         celltype = self.PyNNCellWrapperMetaClass(
@@ -646,15 +855,19 @@ class ComponentArray(object):
         ----------
         port_name : str
             The name of the port to play the signal into
-        signal : neo.AnalogSignal | neo.SpikeTrain
-            The signal to play into the cell
+        signal : neo.AnalogSignal | neo.SpikeTrain | StreamedSpikeInput
+            The signal to play into the cell. Spikes streamed from file as the
+            simulation advances (see StreamedSpikeInput) are only read for
+            the cells local to the process
         properties : dict(str, nineml.Quantity)
             Connection properties when playing into a event receive port
             with static connection properties
         """
         port = self.celltype.model.component_class.receive_port(port_name)
-        if port.nineml_type in ('EventReceivePort',
-                                'EventReceivePortExposure'):
+        if isinstance(signal, (StreamedSpikeInput, StreamedAnalogInput)):
+            self._play_stream(port_name, port, signal, properties)
+        elif port.nineml_type in ('EventReceivePort',
+                                  'EventReceivePortExposure'):
             # Shift the signal times to account for the minimum delay and
             # match the NEURON implementation
             try:
@@ -681,13 +894,7 @@ class ComponentArray(object):
                 label='{}-{}-input'.format(self.name, port_name))
 #             self.celltype.model()._check_connection_properties(port_name,
 #                                                                properties)
-            if len(properties) > 1:
-                raise NotImplementedError(
-                    "Cannot handle more than one connection property per port")
-            elif properties:
-                weight = self.UnitHandler.scale_value(properties[0].quantity)
-            else:
-                weight = 1.0  # The weight var is not used
+            weight = self._input_weight(properties)
             connector = (self.OneToOneConnector()
                          if source_size > 1 else self.AllToAllConnector())
             input_proj = self.PyNNProjectionClass(
@@ -699,26 +906,248 @@ class ComponentArray(object):
         elif port.nineml_type in ('AnalogReceivePort', 'AnalogReducePort',
                                   'AnalogReceivePortExposure',
                                   'AnalogReducePortExposure'):
-            raise NotImplementedError
-#             # Signals are played into NEST cells include a delay (set to be the
-#             # minimum), which is is subtracted from the start of the signal so
-#             # that the effect of the signal aligns with other simulators
-#             self._inputs[port_name] = nest.Create(
-#                 'step_current_generator', 1,
-#                 {'amplitude_values': pq.Quantity(signal, 'pA'),
-#                  'amplitude_times': (
-#                     signal.times.rescale(pq.ms) -
-#                     controller.device_delay * pq.ms),
-#                  'start': float(signal.t_start.rescale(pq.ms)),
-#                  'stop': float(signal.t_stop.rescale(pq.ms))})
-#             nest.Connect(self._inputs[port_name], self._cell,
-#                          syn_spec={
-#                              "receptor_type": self._receive_ports[port_name],
-#                              'delay': controller.device_delay})
+            # The same signal is played into every cell of the array
+            self._inputs[port_name] = self._play_analog(port_name, signal)
         else:
             raise Pype9RuntimeError(
                 "Unrecognised port type '{}' to play signal into".format(port))
 
+    def _play_analog(self, port_name, signal):
+        """
+        Plays an analog signal into a port of every local cell of the array
+
+        Parameters
+        ----------
+        port_name : str
+            The name of the analog receive port to play the signal into
+        signal : neo.AnalogSignal
+            The signal to play into the cells
+
+        Returns
+        -------
+        sources : object
+            The simulator objects the signal is played from
+        """
+        raise NotImplementedError(
+            "Analog signals cannot be played into {} component arrays"
+            .format(self.Simulation.name))
+
+    def _play_stream(self, port_name, port, stream, properties):
+        if (not isinstance(stream, StreamedSpikeInput) or
+            port.nineml_type not in ('EventReceivePort',
+                                     'EventReceivePortExposure')):
+            raise NotImplementedError(
+                "Only streamed spikes can be played into (the event receive "
+                "ports of) component arrays")
+        stream.check_start(
+            float(self.Simulation.active().t.in_units(un.ms)),
+            self._stream_delay)
+        local_indices = np.nonzero(self._mask_local)[0]
+        sources = self._create_stream_sources(port_name,
+                                              self._input_weight(properties))
+        delay = self._stream_delay
+
+        def feed(t_start, t_stop):
+            indices, times = stream.read(t_start + delay, t_stop + delay,
+                                         local_indices)
+            if len(indices):
+                self._feed_stream_sources(sources, indices, times - delay)
+
+        self.Simulation.active().register_input_stream(feed)
+        self._inputs[port_name] = sources
+
+    @property
+    def _stream_delay(self):
+        """
+        The delay (ms) of the connections from the sources created by
+        _create_stream_sources
+        """
+        raise NotImplementedError(
+            "Streamed inputs are not supported by {} component arrays"
+            .format(self.Simulation.name))
+
+    def _create_stream_sources(self, port_name, weight):
+        """
+        Creates the sources streamed spikes are sent from and connects them to
+        the local cells of the array
+
+        Parameters
+        ----------
+        port_name : str
+            The name of the port the spikes are played into
+        weight : float
+            The weight of the connections from the sources
+
+        Returns
+        -------
+        sources : object
+            The simulator objects passed to _feed_stream_sources
+        """
+        raise NotImplementedError(
+            "Streamed inputs are not supported by {} component arrays"
+            .format(self.Simulation.name))
+
+    def _feed_stream_sources(self, sources, indices, times):
+        """
+        Queues spikes to be sent from the sources of a streamed input
+
+        Parameters
+        ----------
+        sources : object
+            The simulator objects returned by _create_stream_sources
+        indices : numpy.ndarray(int)
+            The indices of the (local) cells to send each spike to
+        times : numpy.ndarray(float)
+            The times (ms) to send the spikes, sorted by time
+        """
+        raise NotImplementedError(
+            "Streamed inputs are not supported by {} component arrays"
+            .format(self.Simulation.name))
+
+    def _input_weight(self, properties):
+        if len(properties) > 1:
+            raise NotImplementedError(
+                "Cannot handle more than one connection property per port")
+        elif properties:
+            return self.UnitHandler.scale_value(properties[0].quantity)
+        else:
+            return 1.0  # The weight var is not used
+
+    def get_states(self, names=None):
+        """
+        Gets the values of state variables (or parameters) of all the local
+        cells of the array in bulk
+
+        Parameters
+        ----------
+        names : list(str) | None
+            The names of the state variables and/or parameters to get. If None
+            all state variables are returned
+
+        Returns
+        -------
+        states : numpy.ndarray
+            A structured array with a field for each name and a record for
+            each local cell. The values are in the units used by the
+            simulator for each variable (i.e. the units of the quantities
+            returned by the attributes of the corresponding Cell objects)
+        """
+        if names is None:
+            names = list(self.celltype.model.component_class
+                         .state_variable_names)
+        for name in names:
+            self._check_bulk_name(name)
+        states = np.empty(len(self.local_cells),
+                          dtype=[(str(n), np.float64) for n in names])
+        for name, values in zip(names, self._get_columns(names)):
+            states[name] = values
+        return states
+
+    def set_states(self, states):
+        """
+        Sets the values of state variables (or parameters) of all the local
+        cells of the array in bulk, converting the units of each variable
+        once for the whole array
+
+        Parameters
+        ----------
+        states : numpy.ndarray | dict(str, numpy.ndarray | pq.Quantity)
+            Either a structured array with a field for each variable to set
+            and a record for each local cell, with values in the units used
+            by the simulator (see get_states), or a dictionary mapping the
+            variables to arrays of values, which are converted to the units
+            used by the simulator if they are quantities.
+        """
+        if isinstance(states, np.ndarray):
+            states = dict((n, states[n]) for n in states.dtype.names)
+        num_local = len(self.local_cells)
+        columns = {}
+        for name, values in states.items():
+            self._check_bulk_name(name)
+            if isinstance(values, pq.Quantity):
+                dimension = self.celltype.model.component_class.dimension_of(
+                    name)
+                units = self.UnitHandler.from_pq_quantity(
+                    values.flatten()[:1]).units
+                if units.dimension != dimension:
+                    raise Pype9DimensionError(
+                        "Attempting to set '{}', which has dimension {} to "
+                        "values with dimension {}".format(
+                            name, dimension, units.dimension))
+                values = self.UnitHandler.scale_value(values)
+            values = np.asarray(values, dtype=np.float64).ravel()
+            if len(values) != num_local:
+                raise Pype9UsageError(
+                    "Number of values provided for '{}' ({}) does not match "
+                    "the number of local cells in '{}' ({})".format(
+                        name, len(values), self.name, num_local))
+            columns[name] = values
+        if columns:
+            self._set_columns(columns)
+
+    def get_checkpoint(self):
+        """
+        Gets the dynamic state of all the local cells of the array, i.e. their
+        state variables, current regimes and the 'active' flags of their
+        on-condition triggers (where exported by the simulator)
+
+        Returns
+        -------
+        checkpoint : dict(str, numpy.ndarray)
+            The indices of the local cells ('indices'), their state variables
+            ('states', see get_states), the indices of their current regimes
+            ('regimes') and, if exported by the simulator, a 2D array of their
+            trigger flags ('trigger_flags')
+        """
+        checkpoint = {'indices': np.nonzero(self._mask_local)[0],
+                      'states': self.get_states(),
+                      'regimes': self._get_regimes()}
+        trigger_flags = self._get_trigger_flags()
+        if trigger_flags is not None:
+            checkpoint['trigger_flags'] = trigger_flags
+        return checkpoint
+
+    def set_checkpoint(self, checkpoint):
+        """
+        Sets the dynamic state of all the local cells of the array from a
+        checkpoint returned by get_checkpoint
+
+        Parameters
+        ----------
+        checkpoint : dict(str, numpy.ndarray)
+            The checkpoint of the array, which needs to have been taken with
+            the same cells local to the process
+        """
+        if not np.array_equal(checkpoint['indices'],
+                              np.nonzero(self._mask_local)[0]):
+            raise Pype9UsageError(
+                "Cells local to the process in the checkpoint of '{}' do not "
+                "match the cells of the array local to the process (was the "
+                "checkpoint taken with a different number of processes?)"
+                .format(self.name))
+        self.set_states(checkpoint['states'])
+        self._set_regimes(checkpoint['regimes'])
+        if 'trigger_flags' in checkpoint:
+            self._set_trigger_flags(checkpoint['trigger_flags'])
+
+    def _get_trigger_flags(self):
+        "Trigger flags aren't exported by default"
+        return None
+
+    def _set_trigger_flags(self, flags):  # @UnusedVariable
+        pass
+
+    def _check_bulk_name(self, name):
+        component_class = self.celltype.model.component_class
+        if name not in chain(component_class.state_variable_names,
+                             component_class.parameter_names):
+            raise Pype9NameError(
+                "'{}' is not a state variable or parameter of the '{}' "
+                "component class of '{}' ('{}')".format(
+                    name, component_class.name, self.name, "', '".join(chain(
+                        component_class.state_variable_names,
+                        component_class.parameter_names))))
+
     def _get_port_details(self, port_name):
         """
         Return the communication type of the corresponding port and its fully
@@ -764,7 +1193,7 @@ class ComponentArray(object):
             communicates = port.communicates
         return communicates, port.name
 
-    def record(self, port_name, t_start=None):
+    def record(self, port_name, interval=None):
         """
         Records the port or state variable
 
@@ -772,6 +1201,8 @@ class ComponentArray(object):
         ----------
         port_name : str
             Name of the port to record
+        interval : nineml.Quantity (time) | None
+            The sampling interval of analog signals. Defaults to the timestep
         """
 
     def recording(self, port_name, t_start=None):
@@ -908,9 +1339,12 @@ class ConnectionGroup(object):
         Source component array
     destination : ComponentArray
         Destination component array
+    connector : object | None
+        A connector to connect the group with instead of sampling its
+        connectivity (e.g. from saved connections)
     """
 
-    def __init__(self, nineml_model, source, destination):
+    def __init__(self, nineml_model, source, destination, connector=None):
         rng = self.Simulation.active().properties_rng
         if not isinstance(nineml_model, EventConnectionGroup9ML):
             raise Pype9RuntimeError(
@@ -950,7 +1384,8 @@ class ConnectionGroup(object):
             self,
             presynaptic_population=source,
             postsynaptic_population=destination,
-            connector=nineml_model.connectivity,
+            connector=(connector if connector is not None
+                       else nineml_model.connectivity),
             synapse_type=self.SynapseClass(weight=weight, delay=delay),
             receptor_type=nineml_model.destination_port,
             label=nineml_model.name)
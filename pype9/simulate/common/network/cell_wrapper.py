@@ -81,6 +81,33 @@ class PyNNCellWrapperMetaClass(type):
         return super(PyNNCellWrapperMetaClass, cls).__new__(
             cls, celltype_id + 'PyNN', bases, dct)
 
+    @classmethod
+    def build_batch(cls, component_arrays, build_mode='lazy', **kwargs):
+        """
+        Generates and builds the cell classes of several component arrays
+        together into a single simulator library (see
+        CellMetaClass.build_batch), so that the cell types subsequently
+        created for them don't need to be built individually
+
+        Parameters
+        ----------
+        component_arrays : list(nineml.ComponentArray)
+            The component arrays to build the cell classes for
+        build_mode : str
+            The build mode (see CodeGenerator.generate)
+        kwargs : dict
+            The keyword arguments the cell types will be created with
+        """
+        builds = []
+        for comp_array in component_arrays:
+            props = comp_array.dynamics_properties
+            builds.append(cls._model_kwargs(
+                component_class=props.component_class,
+                default_properties=props,
+                initial_state=list(props.initial_values),
+                initial_regime=props.initial_regime, **kwargs))
+        cls.CellMetaClass.build_batch(builds, build_mode=build_mode)
+
     def __init__(cls, *args, **kwargs):
         """
         Not required, but since I have changed the signature of the new method
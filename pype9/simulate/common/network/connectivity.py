@@ -6,18 +6,26 @@
 """
 from __future__ import absolute_import
 from builtins import zip
+from builtins import object
+import os.path
+import json
 from nineml.user.connectionrule import (
     BaseConnectivity, InverseConnectivity as BaseInverseConnectivity)
-from pyNN.parameters import LazyArray
 import numpy
-from pype9.exceptions import Pype9RuntimeError
+from pype9.exceptions import Pype9RuntimeError, Pype9UsageError
+from pype9.utils.mpi import mpi_comm, is_mpi_master
 
 
 class PyNNConnectivity(BaseConnectivity):
 
     def __init__(self, *args, **kwargs):
         super(PyNNConnectivity, self).__init__(*args, **kwargs)
-        self._prev_connected = None
+        # The connections sampled for the first connection group connected,
+        # stored in compressed sparse row format (indexed by the local
+        # destination cells) so they can be replayed by subsequent connection
+        # groups without gathering a dense connection matrix
+        self._indptr = None
+        self._indices = None
         self._rng = kwargs['rng']
         self._kwargs = kwargs
 
@@ -27,14 +35,18 @@ class PyNNConnectivity(BaseConnectivity):
                 "Connections have not been generated for PyNNConnectivity "
                 "object (they are only generated during network construction "
                 "for efficiency")
-        raise NotImplementedError(
-            "Need to work out connection list from connection map")
+        # NB: Only the connections to cells local to this process are stored
+        for dest, (start, end) in enumerate(zip(self._indptr[:-1],
+                                                self._indptr[1:])):
+            for src in self._indices[start:end]:
+                yield int(src), dest
 
     def connect(self, connection_group):
         if self.has_been_sampled():
-            # Get connection from previously connected projection
-            connector = self._pyNN_module.MapConnector()
-            connector._connect_with_map(connection_group, self._connection_map)
+            # Replay the connections sampled for the previous connection group
+            connector = self._pyNN_module.FromListConnector(
+                self._connection_list)
+            connector.connect(connection_group)
         else:
             if self.rule_properties.lib_type == 'AllToAll':
                 connector_cls = self._pyNN_module.AllToAllConnector
@@ -70,15 +82,61 @@ class PyNNConnectivity(BaseConnectivity):
                 params['rng'] = self._rng
             connector = connector_cls(**params)
             connector.connect(connection_group)
-            self._prev_connected = connection_group
+            self._store_connections(connection_group)
 
     def has_been_sampled(self):
-        return self._prev_connected is not None
+        return self._indptr is not None
+
+    def expected_num_connections(self):
+        """
+        The expected number of connections generated by the connection rule
+        (used to estimate the spike exchange between component arrays)
+        """
+        lib_type = self.rule_properties.lib_type
+        if lib_type == 'AllToAll':
+            num = self.source_size * self.destination_size
+        elif lib_type == 'OneToOne':
+            num = self.destination_size
+        elif lib_type == 'Explicit':
+            num = len(self.rule_properties.property('sourceIndicies'))
+        elif lib_type == 'Probabilistic':
+            num = (float(self.rule_properties.property('probability').value) *
+                   self.source_size * self.destination_size)
+        elif lib_type == 'RandomFanIn':
+            num = (int(self.rule_properties.property('number').value) *
+                   self.destination_size)
+        elif lib_type == 'RandomFanOut':
+            num = (int(self.rule_properties.property('number').value) *
+                   self.source_size)
+        else:
+            raise Pype9UsageError(
+                "Cannot estimate the number of connections generated by "
+                "unrecognised connection rule '{}'".format(lib_type))
+        return float(num)
+
+    def _store_connections(self, connection_group):
+        """
+        Stores the local connections of the connection group in compressed
+        sparse row format, so memory scales with the number of connections
+        instead of the product of the source and destination sizes
+        """
+        conns = numpy.asarray(
+            connection_group.get(['weight'], 'list', gather=False,
+                                 with_address=True),
+            dtype=float).reshape((-1, 3))
+        src = conns[:, 0].astype(int)
+        dest = conns[:, 1].astype(int)
+        order = numpy.lexsort((src, dest))
+        self._indices = src[order]
+        self._indptr = numpy.concatenate(([0], numpy.cumsum(numpy.bincount(
+            dest, minlength=self.destination_size))))
 
     @property
-    def _connection_map(self):
-        return LazyArray(~numpy.isnan(
-            self._prev_connected.get(['weight'], 'array', gather='all')[0]))
+    def _connection_list(self):
+        return numpy.column_stack((
+            self._indices,
+            numpy.repeat(numpy.arange(len(self._indptr) - 1),
+                         numpy.diff(self._indptr))))
 
     def clone(self, memo=None, **kwargs):
         if memo is None:
@@ -99,3 +157,121 @@ class InversePyNNConnectivity(BaseInverseConnectivity):
         raise NotImplementedError(
             "Inverse connectivity from post-synaptic/synapse dynamics to "
             "pre-synaptic dynamics has not been implemented yet.")
+
+
+class ShardedConnections(object):
+    """
+    Connections of the connection groups of a network saved in a columnar
+    binary format, with a '.npy' shard per connection group written by each
+    process (containing the source and destination indices and attributes of
+    the connections to its local cells) and a JSON manifest listing the
+    shards.
+
+    Parameters
+    ----------
+    directory : str
+        The directory the shards and manifest are saved in
+    """
+
+    MANIFEST_FNAME = 'connections.json'
+
+    def __init__(self, directory):
+        self._directory = directory
+        try:
+            with open(os.path.join(directory, self.MANIFEST_FNAME)) as f:
+                self._manifest = json.load(f)
+        except IOError:
+            raise Pype9UsageError(
+                "No saved connections found in '{}' (missing manifest '{}')"
+                .format(directory, self.MANIFEST_FNAME))
+
+    @classmethod
+    def save(cls, connection_groups, directory):
+        """
+        Saves the connections of the connection groups to cells local to the
+        process, in parallel with the other processes
+
+        Parameters
+        ----------
+        connection_groups : list((ConnectionGroup, list(str)))
+            The connection groups to save along with the names of the
+            connection attributes to save with them
+        directory : str
+            The directory to save the shards and manifest in
+        """
+        manifest = {'num_shards': mpi_comm.size, 'connection_groups': {}}
+        for conn_grp, attributes in connection_groups:
+            conns = numpy.asarray(
+                conn_grp.get(attributes, 'list', gather=False,
+                             with_address=True),
+                dtype=float).reshape((-1, 2 + len(attributes)))
+            shard = numpy.empty(
+                len(conns), dtype=[(str('source'), numpy.int64),
+                                   (str('destination'), numpy.int64)] +
+                [(str(a), numpy.float64) for a in attributes])
+            for i, name in enumerate(shard.dtype.names):
+                shard[name] = conns[:, i]
+            numpy.save(os.path.join(directory, cls._shard_fname(
+                conn_grp.label, mpi_comm.rank)), shard)
+            manifest['connection_groups'][conn_grp.label] = {
+                'attributes': list(attributes),
+                'shards': [cls._shard_fname(conn_grp.label, r)
+                           for r in range(mpi_comm.size)]}
+        if is_mpi_master():
+            with open(os.path.join(directory, cls.MANIFEST_FNAME), 'w') as f:
+                json.dump(manifest, f, indent=2)
+
+    def connector(self, name, pyNN_module):
+        """
+        Returns a connector that connects a connection group with its saved
+        connections
+
+        Parameters
+        ----------
+        name : str
+            Name of the connection group
+        pyNN_module : module
+            The connectors module of the PyNN backend for the simulator
+        """
+        try:
+            details = self._manifest['connection_groups'][name]
+        except KeyError:
+            raise Pype9UsageError(
+                "No saved connections for '{}' connection group in '{}'"
+                .format(name, self._directory))
+        return _ShardedConnector(
+            [os.path.join(self._directory, s) for s in details['shards']],
+            details['attributes'], pyNN_module)
+
+    @classmethod
+    def _shard_fname(cls, name, rank):
+        return '{}.{}.npy'.format(name, rank)
+
+
+class _ShardedConnector(object):
+    """
+    Connects a connection group from its saved shards, which are memory-mapped
+    so that only the connections to cells local to the process are read into
+    memory (the number of processes doesn't need to match the number the
+    shards were saved with)
+    """
+
+    def __init__(self, shard_paths, attributes, pyNN_module):
+        self._shard_paths = shard_paths
+        self._attributes = attributes
+        self._pyNN_module = pyNN_module
+
+    def connect(self, connection_group):
+        mask_local = getattr(connection_group.post, '_mask_local', None)
+        local = []
+        for path in self._shard_paths:
+            shard = numpy.load(path, mmap_mode='r')
+            if mask_local is not None:
+                shard = shard[mask_local[shard['destination']]]
+            local.append(numpy.column_stack(
+                [numpy.asarray(shard[n], dtype=float)
+                 for n in shard.dtype.names]).reshape(
+                     (-1, 2 + len(self._attributes))))
+        connector = self._pyNN_module.FromListConnector(
+            numpy.concatenate(local), column_names=self._attributes)
+        connector.connect(connection_group)
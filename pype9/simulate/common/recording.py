@@ -0,0 +1,509 @@
+"""
+  Streaming of recordings to disk during simulations, so that long
+  simulations don't need to hold all of their recordings in memory and the
+  recordings don't need to be written in a single stall at the end.
+
+  Recordings are written into a directory by each process in append-only,
+  columnar binary files:
+
+    <array>.spikes.<rank>.bin
+        records of the index of the spiking cell (int64) and the spike time
+        in ms (float64)
+    <array>.<signal>.<rank>.bin
+        rows of samples (float64) of the signal of each cell recorded by the
+        process, with the indices of the cells, sampling period (ms), start
+        time (ms) and units of the signal in the '.json' file of the same
+        name
+
+  Inputs can be streamed into the cells from files in the same formats (see
+  StreamedSpikeInput and StreamedAnalogInput), so that recorded activity can
+  be played back without loading all of it into memory.
+
+  Author: Thomas G. Close (tclose@oist.jp)
+  Copyright: 2012-2014 Thomas G. Close.
+  License: This file is part of the "NineLine" package, which is released under
+           the MIT Licence, see LICENSE for details.
+"""
+from builtins import object
+import os
+import json
+import threading
+from glob import glob
+import numpy
+import quantities as pq
+import neo
+from pype9.utils.mpi import mpi_comm
+from pype9.exceptions import Pype9UsageError
+try:
+    from queue import Queue
+except ImportError:
+    from Queue import Queue  # @UnresolvedImport @Reimport
+
+SPIKE_DTYPE = numpy.dtype([(str('index'), numpy.int64),
+                           (str('time'), numpy.float64)])
+
+
+class StreamRecorder(object):
+    """
+    Flushes the data recorded from component arrays to disk in chunks. The
+    data are extracted from the simulator in the calling thread and written
+    to disk in a background thread, so the writes overlap the simulation of
+    the next segment. Errors raised while writing are re-raised in the
+    calling thread by the next call to 'flush' or 'close'.
+
+    Parameters
+    ----------
+    directory : str
+        The directory to write the recordings to
+    """
+
+    def __init__(self, directory):
+        if not os.path.exists(directory):
+            try:
+                os.makedirs(directory)
+            except OSError:
+                pass  # Created by another process in the meantime
+        self._directory = directory
+        self._written = set()
+        self._error = None
+        self._queue = Queue()
+        self._thread = threading.Thread(target=self._write_chunks)
+        self._thread.daemon = True
+        self._thread.start()
+
+    def flush(self, component_arrays):
+        """
+        Queues the data recorded from the component arrays since the last
+        flush to be appended to their files, and clears it from the simulator
+        """
+        self._raise_error()
+        for comp_array in component_arrays:
+            block = comp_array.get_data(gather=False, clear=True)
+            for segment in block.segments:
+                self._flush_segment(comp_array.name, segment)
+
+    def close(self):
+        "Waits for the queued chunks to be written"
+        self._queue.put(None)
+        self._thread.join()
+        self._raise_error()
+
+    def _flush_segment(self, name, segment):
+        spikes = []
+        for st in segment.spiketrains:
+            chunk = numpy.empty(len(st), dtype=SPIKE_DTYPE)
+            chunk['index'] = st.annotations['source_index']
+            chunk['time'] = st.rescale(pq.ms).magnitude
+            spikes.append(chunk)
+        if spikes:
+            self._queue.put((self._path(name, 'spikes'),
+                             numpy.concatenate(spikes), None))
+        for asig in segment.analogsignals:
+            try:
+                indices = asig.channel_index.index
+            except AttributeError:
+                indices = asig.array_annotations['channel_index']
+            sidecar = {'indices': [int(i) for i in indices],
+                       'sampling_period': float(
+                           asig.sampling_period.rescale(pq.ms)),
+                       't_start': float(asig.t_start.rescale(pq.ms)),
+                       'units': asig.units.dimensionality.string}
+            self._queue.put((self._path(name, asig.name),
+                             numpy.asarray(asig.magnitude, dtype=float),
+                             sidecar))
+
+    def _write_chunks(self):
+        while True:
+            item = self._queue.get()
+            if item is None:
+                break
+            if self._error is not None:
+                continue  # Drain the queue so that close doesn't block
+            try:
+                self._write_chunk(*item)
+            except Exception as e:
+                self._error = e
+
+    def _write_chunk(self, path, chunk, sidecar):
+        if path not in self._written:
+            mode = 'wb'  # Overwrite files from previous simulations
+            if sidecar is not None:
+                with open(path[:-len('.bin')] + '.json', 'w') as f:
+                    json.dump(sidecar, f)
+            self._written.add(path)
+        else:
+            mode = 'ab'
+        with open(path, mode) as f:
+            chunk.tofile(f)
+
+    def _raise_error(self):
+        "Re-raises an error from the writer thread in the calling thread"
+        if self._error is not None:
+            error, self._error = self._error, None
+            raise error
+
+    def _path(self, name, signal):
+        return os.path.join(self._directory, '{}.{}.{}.bin'.format(
+            name, signal, mpi_comm.rank))
+
+
+class StreamedRecording(object):
+    """
+    Reads recordings streamed to a directory by a StreamRecorder. The files of
+    all processes are memory-mapped so only the requested slices are read.
+
+    Parameters
+    ----------
+    directory : str
+        The directory the recordings were streamed to
+    """
+
+    def __init__(self, directory):
+        self._directory = directory
+
+    def spike_trains(self, name, t_start=None, t_stop=None, indices=None):
+        """
+        Returns the spike trains recorded from a component array
+
+        Parameters
+        ----------
+        name : str
+            Name of the component array
+        t_start : float | None
+            The time (ms) to return the spikes from
+        t_stop : float | None
+            The time (ms) to return the spikes until
+        indices : list(int) | None
+            The indices of the cells to return the spike trains of. If None
+            the spike trains of all cells that spiked are returned
+
+        Returns
+        -------
+        spike_trains : list(neo.SpikeTrain)
+            The spike trains of the cells ordered by their index
+        """
+        spikes = []
+        for path in self._files(name, 'spikes'):
+            shard = numpy.memmap(path, dtype=SPIKE_DTYPE, mode='r')
+            mask = numpy.ones(len(shard), dtype=bool)
+            if t_start is not None:
+                mask &= shard['time'] >= t_start
+            if t_stop is not None:
+                mask &= shard['time'] < t_stop
+            if indices is not None:
+                mask &= numpy.in1d(shard['index'], indices)
+            spikes.append(numpy.array(shard[mask]))
+        spikes = (numpy.concatenate(spikes) if spikes
+                  else numpy.empty(0, dtype=SPIKE_DTYPE))
+        if indices is None:
+            indices = numpy.unique(spikes['index'])
+        t_stop = (t_stop if t_stop is not None
+                  else (spikes['time'].max() if len(spikes) else 0.0))
+        return [neo.SpikeTrain(
+            numpy.sort(spikes['time'][spikes['index'] == i]), units='ms',
+            t_start=(t_start if t_start is not None else 0.0) * pq.ms,
+            t_stop=t_stop * pq.ms, source_index=int(i)) for i in indices]
+
+    def analog_signal(self, name, signal, t_start=None, t_stop=None,
+                      indices=None):
+        """
+        Returns the analog signal recorded from the cells of a component array
+
+        Parameters
+        ----------
+        name : str
+            Name of the component array
+        signal : str
+            Name of the recorded signal
+        t_start : float | None
+            The time (ms) to return the signal from
+        t_stop : float | None
+            The time (ms) to return the signal until
+        indices : list(int) | None
+            The indices of the cells to return the signals of. If None the
+            signals of all recorded cells are returned
+
+        Returns
+        -------
+        signal : neo.AnalogSignal
+            The signal with a channel for each cell ordered by their index
+        """
+        columns = {}
+        units = 'dimensionless'
+        start = end = period = rec_start = None
+        for path in self._files(name, signal):
+            with open(path[:-len('.bin')] + '.json') as f:
+                sidecar = json.load(f)
+            shard = numpy.memmap(path, dtype=float, mode='r').reshape(
+                (-1, len(sidecar['indices'])))
+            period = sidecar['sampling_period']
+            rec_start = sidecar['t_start']
+            units = sidecar['units']
+            start = (0 if t_start is None
+                     else max(int(round((t_start - rec_start) / period)), 0))
+            end = (len(shard) if t_stop is None
+                   else min(int(round((t_stop - rec_start) / period)),
+                            len(shard)))
+            for col, index in enumerate(sidecar['indices']):
+                if indices is None or index in indices:
+                    columns[index] = numpy.array(shard[start:end, col])
+        if not columns:
+            raise Pype9UsageError(
+                "No streamed recordings of '{}' from '{}' found in '{}'"
+                .format(signal, name, self._directory))
+        order = sorted(columns)
+        asig = neo.AnalogSignal(
+            numpy.column_stack([columns[i] for i in order]), units=units,
+            sampling_period=period * pq.ms,
+            t_start=(rec_start + start * period) * pq.ms, name=signal)
+        asig.annotate(source_indices=order)
+        return asig
+
+    def _files(self, name, signal):
+        return sorted(glob(os.path.join(
+            self._directory, '{}.{}.*.bin'.format(name, signal))))
+
+
+class StreamedSpikeInput(object):
+    """
+    Spikes to play into the cells of a component array (or a single cell)
+    that are read from a memory-mapped file as the simulation advances. Before
+    each segment of the simulation (see the 'stream_interval' option of
+    Simulation) only the spikes of that segment to the locally hosted cells
+    are read and queued, so the memory required doesn't depend on the
+    duration of the input.
+
+    The file consists of records of the index of the receiving cell (int64)
+    and the spike time in ms (float64) sorted by time (see 'write'). The
+    index is ignored when played into a single cell.
+
+    Parameters
+    ----------
+    path : str
+        Path to the file of spike records
+    """
+
+    def __init__(self, path):
+        self._path = path
+        if os.path.getsize(path):
+            self._spikes = numpy.memmap(path, dtype=SPIKE_DTYPE, mode='r')
+        else:
+            self._spikes = numpy.empty(0, dtype=SPIKE_DTYPE)
+
+    @property
+    def path(self):
+        return self._path
+
+    def __len__(self):
+        return len(self._spikes)
+
+    def read(self, t_start, t_stop, indices=None):
+        """
+        Reads the spikes with times in the interval (t_start, t_stop]
+
+        Parameters
+        ----------
+        t_start : float
+            The time (ms) to read the spikes after
+        t_stop : float
+            The time (ms) to read the spikes until (inclusive)
+        indices : numpy.ndarray(int) | None
+            The indices of the cells to read the spikes of. If None the spikes
+            of all cells are read
+
+        Returns
+        -------
+        indices : numpy.ndarray(int)
+            The indices of the cells the spikes are played into
+        times : numpy.ndarray(float)
+            The times of the spikes (ms)
+        """
+        # The times are sorted so only the pages that contain the interval
+        # (and the ones visited by the binary search) are read from disk
+        start, end = numpy.searchsorted(self._spikes['time'],
+                                        (t_start, t_stop), side='right')
+        chunk = numpy.array(self._spikes[start:end])
+        if indices is not None:
+            chunk = chunk[numpy.in1d(chunk['index'], indices)]
+        return chunk['index'], chunk['time']
+
+    def check_start(self, t_start, delay):
+        """
+        Checks that no spikes need to be sent before the simulation starts to
+        arrive after the given delay (ms)
+        """
+        if len(self._spikes) and self._spikes['time'][0] <= t_start + delay:
+            raise Pype9UsageError(
+                "Some spike times in '{}' are less than the device delay ({} "
+                "ms) after the start of the simulation ({} ms) and so can't "
+                "be played into the cells".format(self._path, delay,
+                                                   t_start))
+
+    @classmethod
+    def write(cls, path, spike_trains, indices=None):
+        """
+        Writes spike trains to a file that can be streamed into cells
+
+        Parameters
+        ----------
+        path : str
+            Path of the file to write
+        spike_trains : list(neo.SpikeTrain)
+            The spike trains to play into each cell
+        indices : list(int) | None
+            The indices of the cells to play the spike trains into. If None
+            the spike train at each position is played into the cell of the
+            same index
+
+        Returns
+        -------
+        streamed_input : StreamedSpikeInput
+            The input to play into the cells
+        """
+        if indices is None:
+            indices = range(len(spike_trains))
+        spikes = []
+        for index, st in zip(indices, spike_trains):
+            chunk = numpy.empty(len(st), dtype=SPIKE_DTYPE)
+            chunk['index'] = index
+            chunk['time'] = st.rescale(pq.ms).magnitude
+            spikes.append(chunk)
+        spikes = (numpy.concatenate(spikes) if spikes
+                  else numpy.empty(0, dtype=SPIKE_DTYPE))
+        spikes = spikes[numpy.argsort(spikes['time'], kind='mergesort')]
+        spikes.tofile(path)
+        return cls(path)
+
+
+class StreamedAnalogInput(object):
+    """
+    An analog signal to play into a cell that is read from a memory-mapped
+    file segment by segment as the simulation advances (see
+    StreamedSpikeInput).
+
+    The file consists of rows of samples (float64) of a channel for each cell,
+    with the indices of the cells, sampling period (ms), start time (ms) and
+    units of the signal in the '.json' file of the same name, i.e. the format
+    signals are streamed to by StreamRecorder (see 'write').
+
+    Parameters
+    ----------
+    path : str
+        Path to the '.bin' file of samples
+    """
+
+    def __init__(self, path):
+        self._path = path
+        with open(path[:-len('.bin')] + '.json') as f:
+            sidecar = json.load(f)
+        self._indices = list(sidecar['indices'])
+        self._sampling_period = sidecar['sampling_period']
+        self._t_start = sidecar['t_start']
+        self._units = sidecar['units']
+        if os.path.getsize(path):
+            self._samples = numpy.memmap(path, dtype=float, mode='r').reshape(
+                (-1, len(self._indices)))
+        else:
+            self._samples = numpy.empty((0, len(self._indices)))
+
+    @property
+    def path(self):
+        return self._path
+
+    @property
+    def indices(self):
+        return self._indices
+
+    @property
+    def units(self):
+        return pq.Quantity(1.0, self._units)
+
+    @property
+    def t_start(self):
+        "The time of the first sample (ms)"
+        return self._t_start
+
+    @property
+    def t_stop(self):
+        "The time after the last sample (ms)"
+        return self._t_start + len(self._samples) * self._sampling_period
+
+    def read(self, t_start, t_stop, indices=None):
+        """
+        Reads the samples with times in the interval (t_start, t_stop]
+
+        Parameters
+        ----------
+        t_start : float
+            The time (ms) to read the samples after
+        t_stop : float
+            The time (ms) to read the samples until (inclusive)
+        indices : list(int) | None
+            The indices of the cells to read the channels of. If None the
+            channels of all cells are read
+
+        Returns
+        -------
+        times : numpy.ndarray(float)
+            The times of the samples (ms)
+        samples : numpy.ndarray(float)
+            The samples (in the units of the signal) with a column for each
+            of the requested cells
+        """
+        period = self._sampling_period
+        start = max(int(numpy.floor((t_start - self._t_start) / period)) + 1,
+                    0)
+        end = min(int(numpy.floor((t_stop - self._t_start) / period)) + 1,
+                  len(self._samples))
+        start = min(start, end)
+        if indices is None:
+            columns = slice(None)
+        else:
+            columns = [self._indices.index(i) for i in indices]
+        return (self._t_start + numpy.arange(start, end) * period,
+                numpy.array(self._samples[start:end, columns]))
+
+    def check_start(self, t_start, delay):
+        """
+        Checks that the signal doesn't need to be sent before the simulation
+        starts to arrive after the given delay (ms)
+        """
+        if self._t_start <= t_start + delay:
+            raise Pype9UsageError(
+                "Start time of signal in '{}' ({} ms) must be greater than "
+                "the device delay ({} ms) after the start of the simulation "
+                "({} ms)".format(self._path, self._t_start, delay, t_start))
+
+    @classmethod
+    def write(cls, path, signal, indices=None):
+        """
+        Writes an analog signal to a file that can be streamed into cells
+
+        Parameters
+        ----------
+        path : str
+            Path of the '.bin' file to write
+        signal : neo.AnalogSignal
+            The signal with a channel to play into each cell
+        indices : list(int) | None
+            The indices of the cells to play the channels into. If None the
+            channel at each position is played into the cell of the same
+            index
+
+        Returns
+        -------
+        streamed_input : StreamedAnalogInput
+            The input to play into the cells
+        """
+        samples = numpy.asarray(signal.magnitude, dtype=float).reshape(
+            (len(signal), -1))
+        if indices is None:
+            indices = range(samples.shape[1])
+        with open(path[:-len('.bin')] + '.json', 'w') as f:
+            json.dump({'indices': [int(i) for i in indices],
+                       'sampling_period': float(
+                           signal.sampling_period.rescale(pq.ms)),
+                       't_start': float(signal.t_start.rescale(pq.ms)),
+                       'units': signal.units.dimensionality.string}, f)
+        samples.tofile(path)
+        return cls(path)
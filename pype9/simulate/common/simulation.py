@@ -1,5 +1,7 @@
 from builtins import object
 from abc import ABCMeta, abstractmethod
+import os.path
+import json
 from nineml import units as un
 import numpy
 import time
@@ -7,6 +9,7 @@ from pype9.exceptions import Pype9UsageError, Pype9NoActiveSimulationError
 from pyNN.random import NumpyRNG
 from future.utils import with_metaclass
 from pype9.utils.logging import logger
+from .recording import StreamRecorder
 
 
 class Simulation(with_metaclass(ABCMeta, object)):
@@ -56,15 +59,36 @@ class Simulation(with_metaclass(ABCMeta, object)):
         The maximum delay in the network. If None the max delay will be
         calculated from the first network to be created (if a single cell
         then it will be the same as the timestep)
+    stream_recordings : str | None
+        A directory to stream the recordings of component arrays to during
+        the simulation (see pype9.simulate.common.recording), instead of
+        keeping them in memory until the end of the simulation. They can be
+        read back with StreamedRecording
+    stream_interval : nineml.Quantity (time)
+        The interval of simulated time between flushes of the streamed
+        recordings and reads of the streamed inputs (see
+        StreamedSpikeInput and StreamedAnalogInput)
+    num_threads : int
+        The number of threads to run on each MPI process. A seed is derived
+        for each thread of each process (see all_dynamics_seeds), so results
+        are reproducible for a given number of processes and threads
     options : dict(str, object)
         Options passed to the simulator-specific methods
     """
 
     max_seed = 2 ** 32 - 1
 
+    STREAM_INTERVAL_DEFAULT = 1000.0 * un.ms
+
+    NUM_THREADS_DEFAULT = 1
+
+    CHECKPOINT_MANIFEST_FNAME = 'checkpoint.json'
+
     def __init__(self, dt, t_start=0.0 * un.s, seed=None, properties_seed=None,
                  min_delay=1 * un.ms, max_delay=10 * un.ms,
-                 code_generator=None, build_base_dir=None, **options):
+                 code_generator=None, build_base_dir=None,
+                 stream_recordings=None, stream_interval=None,
+                 num_threads=None, **options):
         self._check_units('dt', dt, un.time)
         self._check_units('t_start', dt, un.time)
         self._check_units('min_delay', dt, un.time, allow_none=True)
@@ -75,8 +99,23 @@ class Simulation(with_metaclass(ABCMeta, object)):
         self._min_delay = min_delay if min_delay > dt else dt
         self._max_delay = max_delay if max_delay > dt else dt
         self._options = options
+        if stream_interval is None:
+            stream_interval = self.STREAM_INTERVAL_DEFAULT
+        self._check_units('stream_interval', stream_interval, un.time)
+        self._stream_dir = stream_recordings
+        self._stream_interval = stream_interval
+        self._stream_recorder = None
+        if num_threads is None:
+            num_threads = self.NUM_THREADS_DEFAULT
+        if int(num_threads) != num_threads or num_threads < 1:
+            raise Pype9UsageError(
+                "Number of threads per process must be a positive integer "
+                "(provided {})".format(num_threads))
+        self._threads_per_proc = int(num_threads)
         self._registered_cells = None
         self._registered_arrays = None
+        self._input_streams = None
+        self._checkpoint = None
         if seed is not None and (seed < 0 or seed > self.max_seed):
             raise Pype9UsageError(
                 "Provided seed {} is out of range, must be between (0 and {})"
@@ -117,11 +156,16 @@ class Simulation(with_metaclass(ABCMeta, object)):
         self._prepare()
         self._registered_cells = []
         self._registered_arrays = []
+        self._input_streams = []
+        self._checkpoint = None
+        if self._stream_dir is not None:
+            self._stream_recorder = StreamRecorder(self._stream_dir)
         self.__class__._active = self
 
     def deactivate(self, kill_cells=True):
         t_stop = self.t
         self.__class__._active = None
+        stream_recorder, self._stream_recorder = self._stream_recorder, None
         if kill_cells:
             for cell in self._registered_cells:
                 cell._kill(t_stop)
@@ -132,6 +176,10 @@ class Simulation(with_metaclass(ABCMeta, object)):
                 "Not killing cells as an uncaught exception was thrown")
         self._registered_cells = None
         self._registered_arrays = None
+        self._input_streams = None
+        # Closed last as it re-raises any errors writing the recordings
+        if stream_recorder is not None:
+            stream_recorder.close()
 
     @property
     def dt(self):
@@ -149,6 +197,11 @@ class Simulation(with_metaclass(ABCMeta, object)):
     def min_delay(self):
         return self._min_delay
 
+    @property
+    def threads_per_process(self):
+        "The number of threads run on each MPI process"
+        return self._threads_per_proc
+
     @property
     def max_delay(self):
         return self._max_delay
@@ -247,8 +300,148 @@ class Simulation(with_metaclass(ABCMeta, object)):
         if not self._running:
             self._initialize()
             self._running = True
-        self._run(t_stop, **kwargs)
-        self._t = t_stop
+            if self._checkpoint is not None:
+                self._restore_checkpoint()
+                self._checkpoint = None
+        if self._stream_recorder is None and not self._input_streams:
+            self._run(t_stop, **kwargs)
+            self._t = t_stop
+        else:
+            # Run in segments, reading the streamed inputs before and flushing
+            # the recordings after each one (they are written in the
+            # background while the next segment runs)
+            while self._t < t_stop:
+                t_segment = self._t + self._stream_interval
+                if t_segment > t_stop:
+                    t_segment = t_stop
+                self._feed_input_streams(self._t, t_segment)
+                # NB: The simulator backends advance the simulation by the
+                # time passed to _run
+                self._run(t_segment - self._t, **kwargs)
+                self._t = t_segment
+                if self._stream_recorder is not None:
+                    self._stream_recorder.flush(self._registered_arrays)
+
+    def checkpoint(self, path, networks=()):
+        """
+        Saves the dynamic state of all component arrays in the simulation (the
+        state variables, current regime and, where exported by the simulator,
+        the 'active' flags of the on-condition triggers of every cell) to
+        binary files in a directory, from which a simulation of the same
+        network can be warm-started with ``restore``. Each process writes the
+        states of its local cells to '<array>.<rank>.npz' files.
+
+        Note that spikes that are in flight (i.e. queued for delivery to the
+        cells) are not saved, and as the states of the random number
+        generators of the simulators are not accessible, random processes
+        are drawn from the streams seeded by the restoring simulation.
+
+        Parameters
+        ----------
+        path : str
+            The directory to save the checkpoint in
+        networks : list(Network)
+            Networks to save the connections of alongside the states, in
+            '.npy' shards in 'connections/<network-name>' sub-directories of
+            the checkpoint. They can be reloaded (instead of being regenerated)
+            by passing the sub-directory to the 'load_connections' argument
+            of the network
+        """
+        if self._registered_arrays is None:
+            raise Pype9UsageError(
+                "Can only checkpoint simulations inside the simulation "
+                "context")
+        self._makedirs(path)
+        if self.mpi_rank() == 0:
+            with open(os.path.join(path,
+                                   self.CHECKPOINT_MANIFEST_FNAME), 'w') as f:
+                json.dump({
+                    't': float(self.t.in_units(un.ms)),
+                    'dt': float(self.dt.in_units(un.ms)),
+                    'num_processes': self.num_processes(),
+                    'base_seed': self.base_seed,
+                    'base_properties_seed': self.base_properties_seed,
+                    'global_seed': self.global_seed,
+                    'component_arrays': [
+                        a.name for a in self._registered_arrays]}, f)
+        for array in self._registered_arrays:
+            numpy.savez(self._checkpoint_path(path, array.name),
+                        **array.get_checkpoint())
+        for network in networks:
+            conn_dir = os.path.join(path, 'connections', network.nineml.name)
+            self._makedirs(conn_dir)
+            network.save_connections(conn_dir, format='npy')
+
+    def restore(self, path):
+        """
+        Restores the dynamic state of the component arrays in the simulation
+        from a checkpoint saved by ``checkpoint``. The arrays need to have
+        been created (e.g. from the connections saved with the checkpoint)
+        with the same names and number of processes as when the checkpoint
+        was taken. The states are set when the simulation is initialised at
+        the start of the first run, which starts from the t_start of
+        the restoring simulation (the time the checkpoint was taken is
+        saved as 't' in the manifest of the checkpoint)
+
+        Parameters
+        ----------
+        path : str
+            The directory the checkpoint was saved in
+        """
+        if self._registered_arrays is None or self._running:
+            raise Pype9UsageError(
+                "Can only restore checkpoints inside the simulation context "
+                "before it starts running")
+        try:
+            with open(os.path.join(path,
+                                   self.CHECKPOINT_MANIFEST_FNAME)) as f:
+                manifest = json.load(f)
+        except IOError:
+            raise Pype9UsageError(
+                "'{}' does not contain a checkpoint".format(path))
+        if manifest['num_processes'] != self.num_processes():
+            raise Pype9UsageError(
+                "Checkpoint in '{}' was taken with {} processes, cannot be "
+                "restored with {}".format(path, manifest['num_processes'],
+                                          self.num_processes()))
+        if float(self.dt.in_units(un.ms)) != manifest['dt']:
+            logger.warning(
+                "Restoring checkpoint taken with a timestep of {} ms into "
+                "simulation with a timestep of {}".format(manifest['dt'],
+                                                          self.dt))
+        if manifest['global_seed'] != self.global_seed:
+            logger.info(
+                "Random processes of the restored simulation are drawn from "
+                "different streams than the checkpointed simulation (global "
+                "seed {})".format(manifest['global_seed']))
+        self._checkpoint = {}
+        for array in self._registered_arrays:
+            fname = self._checkpoint_path(path, array.name)
+            if not os.path.exists(fname):
+                raise Pype9UsageError(
+                    "No checkpoint of '{}' found in '{}'"
+                    .format(array.name, path))
+            with numpy.load(fname) as f:
+                self._checkpoint[array.name] = dict(f)
+
+    def _restore_checkpoint(self):
+        """
+        Sets the states of the component arrays from the restored checkpoint
+        after the simulator has been initialised
+        """
+        for array in self._registered_arrays:
+            array.set_checkpoint(self._checkpoint[array.name])
+
+    @classmethod
+    def _makedirs(cls, path):
+        if not os.path.exists(path):
+            try:
+                os.makedirs(path)
+            except OSError:
+                pass  # Created by another process in the meantime
+
+    def _checkpoint_path(self, path, name):
+        return os.path.join(path, '{}.{}.npz'.format(name, self.mpi_rank()))
 
     @abstractmethod
     def _run(self, t_stop, **kwargs):  # @UnusedVariable
@@ -262,6 +455,23 @@ class Simulation(with_metaclass(ABCMeta, object)):
             The time to run the simulation until
         """
 
+    def _feed_input_streams(self, t_start, t_stop):
+        """
+        Queues the inputs streamed into the cells over a segment of the
+        simulation
+
+        Parameters
+        ----------
+        t_start : nineml.Quantity (time)
+            The start of the segment
+        t_stop : nineml.Quantity (time)
+            The end of the segment
+        """
+        t_start = float(t_start.in_units(un.ms))
+        t_stop = float(t_stop.in_units(un.ms))
+        for feed in self._input_streams:
+            feed(t_start, t_stop)
+
     @abstractmethod
     def _prepare(self):
         "Reset the simulation and prepare it for creating new cells/networks"
@@ -283,9 +493,9 @@ class Simulation(with_metaclass(ABCMeta, object)):
     def num_processes(self):
         "The number of MPI processes"
 
-    @abstractmethod
     def num_threads(self):
         "The total number of threads across all MPI nodes"
+        return self.num_processes() * self._threads_per_proc
 
     @classmethod
     def gen_seed(cls):
@@ -308,6 +518,20 @@ class Simulation(with_metaclass(ABCMeta, object)):
                 .format(cell_code_gen, self.code_generator))
         self._registered_arrays.append(array)
 
+    def register_input_stream(self, feed):
+        """
+        Registers an input that is streamed into cells during the simulation,
+        which runs the simulation in segments of 'stream_interval'
+
+        Parameters
+        ----------
+        feed : function(float, float)
+            Called before each segment of the simulation with the start and
+            end times of the segment (ms) to queue the inputs that are sent
+            in the interval (start, end]
+        """
+        self._input_streams.append(feed)
+
     @classmethod
     def active(cls):
         if cls._active is not None:
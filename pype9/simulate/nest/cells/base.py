@@ -17,6 +17,8 @@ from nineml import units as un
 from ..code_gen import CodeGenerator
 from pype9.simulate.nest.simulation import Simulation
 from pype9.simulate.common.cells import base
+from pype9.simulate.common.recording import (
+    StreamedSpikeInput, StreamedAnalogInput)
 from pype9.annotations import PYPE9_NS, MEMBRANE_VOLTAGE, BUILD_TRANS
 from pype9.exceptions import (
     Pype9UsageError, Pype9Unsupported9MLException)
@@ -47,7 +49,21 @@ class Cell(base.Cell):
         nest.SetStatus(self._cell, self.code_generator.REGIME_VARNAME,
                        self._regime_index)
 
-    def record(self, port_name, interval=None, **kwargs):  # @UnusedVariable @IgnorePep8
+    def record(self, port_name, interval=None, reduction=None, **kwargs):  # @UnusedVariable @IgnorePep8
+        """
+        Records a send port or state variable
+
+        Parameters
+        ----------
+        port_name : str
+            Name of the port (or state variable) to record
+        interval : nineml.Quantity (time) | None
+            The sampling interval of analog signals. Defaults to the timestep
+        reduction : str | None
+            Record the 'mean', 'min' or 'max' of a state variable over each
+            sampling interval instead of its value at the end of it. Requires
+            the cell to be built with the 'record_reductions' option
+        """
         # Create dictionaries for storing local recordings. These are not
         # created initially to save memory if recordings are not required or
         # handled externally
@@ -74,6 +90,15 @@ class Cell(base.Cell):
                 interval = Simulation.active().dt
             interval = float(interval.in_units(un.ms))
             variable_name = self.build_name(port_name)
+            if reduction is not None:
+                variable_name += '__' + reduction
+                if variable_name not in nest.GetStatus(
+                        self._cell, 'recordables')[0]:
+                    raise Pype9UsageError(
+                        "Cannot record '{}' of '{}', reductions are only "
+                        "available for state variables of cells built with "
+                        "the 'record_reductions' option".format(
+                            reduction, port_name))
             self._recorders[port_name] = recorder = nest.Create(
                 'multimeter', 1, {"interval": interval})
             nest.SetStatus(recorder, {'record_from': [variable_name]})
@@ -122,15 +147,17 @@ class Cell(base.Cell):
                 t_start=t_start, t_stop=t_stop, name=port_name)
         else:
             port_name = self.build_name(port_name)
-            events, interval = nest.GetStatus(self._recorders[port_name],
-                                              ('events', 'interval'))[0]
+            events, interval, record_from = nest.GetStatus(
+                self._recorders[port_name],
+                ('events', 'interval', 'record_from'))[0]
             try:
                 port = self._nineml.component_class.port(port_name)
             except NineMLNameError:
                 port = self._nineml.component_class.state_variable(port_name)
             unit_str = self.unit_handler.dimension_to_unit_str(
                 port.dimension, one_as_dimensionless=True)
-            variable_name = self.build_name(port_name)
+            # Potentially a reduction of the variable
+            variable_name = record_from[0]
             signal = self._trim_analog_signal(events[variable_name],
                                               t_start, interval * pq.ms)
             data = neo.AnalogSignal(
@@ -138,6 +165,24 @@ class Cell(base.Cell):
                 t_start=t_start, units=unit_str, name=port_name)
         return data
 
+    @property
+    def counters(self):
+        """
+        The counters of the work done in the update of the cell (ODE steps,
+        rejected steps, solver re-initialisations, transitions fired from each
+        regime, events received on each port and the high-water mark of
+        simultaneous transitions). Requires the cell to be built with the
+        'instrument' option
+        """
+        return _get_counters(self._cell)[0]
+
+    def reset_counters(self):
+        """
+        Resets the counters of the cell (see Cell.counters). Requires the cell
+        to be built with the 'instrument' option
+        """
+        _reset_counters(self._cell)
+
     def _regime_recording(self):
         events, interval = nest.GetStatus(
             self._recorders[self.code_generator.REGIME_VARNAME],
@@ -148,6 +193,22 @@ class Cell(base.Cell):
             t_start=self.unit_handler.to_pq_quantity(self._t_start),
             name=self.code_generator.REGIME_VARNAME)
 
+    def _regime_transitions(self):
+        # Raises a KeyError if the regime hasn't been recorded
+        self._recorders[self.code_generator.REGIME_VARNAME]
+        if 'regime_log_times' not in nest.GetStatus(self._cell)[0]:
+            return super(Cell, self)._regime_transitions()
+        # Use the exact times of the transitions logged by the cell instead of
+        # those sampled by the regime recorder
+        times, indices = nest.GetStatus(
+            self._cell, ('regime_log_times', 'regime_log_indices'))[0]
+        if self.is_dead():
+            t_stop = self._t_stop
+        else:
+            t_stop = self.Simulation.active().t
+        return (numpy.asarray(times) * pq.ms, list(indices),
+                self.unit_handler.to_pq_quantity(t_stop))
+
     def build_name(self, varname):
         # Get mapped port name if port corresponds to membrane voltage
         if varname == self.component_class.annotations.get(
@@ -168,14 +229,18 @@ class Cell(base.Cell):
         ----------
         port_name : str
             The name of the receive port to play the signal into
-        signal : neo.AnalogSignal (current) | neo.SpikeTrain
-            Signal to play into the port
+        signal : neo.AnalogSignal (current) | neo.SpikeTrain |
+                 StreamedSpikeInput | StreamedAnalogInput
+            Signal to play into the port. Streamed inputs are read from file
+            segment by segment as the simulation advances
         properties : list(nineml.Property)
             The connection properties of the event port
         """
         port = self.component_class.receive_port(port_name)
-        if port.nineml_type in ('EventReceivePort',
-                                'EventReceivePortExposure'):
+        if isinstance(signal, (StreamedSpikeInput, StreamedAnalogInput)):
+            self._play_stream(port_name, port, signal, properties)
+        elif port.nineml_type in ('EventReceivePort',
+                                  'EventReceivePortExposure'):
             # Shift the signal times to account for the minimum delay and
             # match the NEURON implementation
             spike_times = (numpy.asarray(signal.rescale(pq.ms)) -
@@ -228,6 +293,62 @@ class Cell(base.Cell):
             raise Pype9UsageError(
                 "Unrecognised port type '{}' to play signal into".format(port))
 
+    def _play_stream(self, port_name, port, stream, properties):
+        delay = self.device_delay_ms
+        stream.check_start(float(self.Simulation.active().t.in_units(un.ms)),
+                           delay)
+        is_event_port = port.nineml_type in ('EventReceivePort',
+                                             'EventReceivePortExposure')
+        if isinstance(stream, StreamedSpikeInput):
+            if not is_event_port:
+                raise Pype9UsageError(
+                    "Streamed spikes can only be played into event receive "
+                    "ports ('{}' is not)".format(port_name))
+            generator = nest.Create('spike_generator', 1)
+            syn_spec = {'receptor_type': self._receive_ports[port_name],
+                        'delay': delay}
+            self._check_connection_properties(port_name, properties)
+            if len(properties) > 1:
+                raise NotImplementedError(
+                    "Cannot handle more than one connection property per port")
+            elif properties:
+                syn_spec['weight'] = self.unit_handler.scale_value(
+                    properties[0].quantity)
+
+            def feed(t_start, t_stop):
+                _, times = stream.read(t_start + delay, t_stop + delay)
+                # The previous spike times are all in the past so they can be
+                # replaced by the ones in the next segment
+                if len(times):
+                    nest.SetStatus(generator, {
+                        'spike_times': [float(t) for t in times - delay]})
+        else:
+            if is_event_port:
+                raise Pype9UsageError(
+                    "Streamed analog signals can't be played into event "
+                    "receive ports ('{}')".format(port_name))
+            if len(stream.indices) != 1:
+                raise Pype9UsageError(
+                    "Streamed analog signals played into a cell must have a "
+                    "single channel ('{}' has {})".format(
+                        stream.path, len(stream.indices)))
+            generator = nest.Create('step_current_generator', 1, {
+                'stop': stream.t_stop - delay})
+            syn_spec = {'receptor_type': self._receive_ports[port_name],
+                        'delay': delay}
+            scale = float(stream.units.rescale(pq.pA))
+
+            def feed(t_start, t_stop):
+                times, samples = stream.read(t_start + delay, t_stop + delay)
+                if len(times):
+                    nest.SetStatus(generator, {
+                        'amplitude_times': [float(t) for t in times - delay],
+                        'amplitude_values': [float(v) for v in
+                                             samples[:, 0] * scale]})
+        nest.Connect(generator, self._cell, syn_spec=syn_spec)
+        self._inputs[port_name] = generator
+        self.Simulation.active().register_input_stream(feed)
+
     def connect(self, sender, send_port_name, receive_port_name, delay=None,
                 properties=None):
         """
@@ -306,3 +427,27 @@ class CellMetaClass(base.CellMetaClass):
     CodeGenerator = CodeGenerator
     BaseCellClass = Cell
     Simulation = Simulation
+
+
+def _get_counters(node_ids):
+    """
+    Gets the 'counters' status dictionaries of instrumented NEST nodes
+    """
+    statuses = nest.GetStatus(node_ids)
+    _check_instrumented(statuses)
+    return [status['counters'] for status in statuses]
+
+
+def _reset_counters(node_ids):
+    """
+    Resets the counters of instrumented NEST nodes (of the same model)
+    """
+    _check_instrumented(nest.GetStatus(node_ids[:1]))
+    nest.SetStatus(node_ids, {'reset_counters': True})
+
+
+def _check_instrumented(statuses):
+    if any('counters' not in status for status in statuses):
+        raise Pype9UsageError(
+            "Counters are only available for cells built with the "
+            "'instrument' option")
@@ -9,6 +9,7 @@
 """
 from __future__ import absolute_import
 from future.utils import PY3
+from past.builtins import basestring
 import os
 import sys
 from os import path
@@ -17,7 +18,12 @@ import re
 import shutil
 from datetime import datetime
 import errno
+import hashlib
+from itertools import chain
+from functools import reduce
+import sympy
 import nest
+from nineml.abstraction import Expression
 from pype9.simulate.nest.units import UnitHandler
 from pype9.simulate.common.code_gen import BaseCodeGenerator
 from pype9.utils.paths import remove_ignore_missing, add_lib_path
@@ -35,12 +41,69 @@ class CodeGenerator(BaseCodeGenerator):
     ODE_SOLVER_DEFAULT = 'gsl'
     REGIME_VARNAME = '__regime__'
     SS_SOLVER_DEFAULT = None
+    # The maximum number of steady-state solutions cached per model, which
+    # are reused by instances with the same parameters and used to warm-start
+    # the solver for instances with different ones
+    STEADY_STATE_CACHE_SIZE_DEFAULT = 1024
     MAX_STEP_SIZE_DEFAULT = 0.01  # Used for CVODE/IDA, FIXME: not sure best value!!! @IgnorePep8
     ABS_TOLERANCE_DEFAULT = 1e-3
     REL_TOLERANCE_DEFAULT = 0.0
     GSL_JACOBIAN_APPROX_STEP_DEFAULT = 0.01
+    # Whether to differentiate the time derivatives symbolically to provide
+    # the implicit GSL steppers with analytic Jacobians instead of
+    # finite-difference approximations
+    ANALYTIC_JACOBIAN_DEFAULT = True
+    # GSL stepping algorithms (gsl_odeiv2_step_*) that can be selected with
+    # the 'gsl_stepper' option
+    GSL_STEPPERS = ('rk2', 'rk4', 'rkf45', 'rkck', 'rk8pd', 'rk1imp',
+                    'rk2imp', 'rk4imp', 'bsimp', 'msadams', 'msbdf')
+    GSL_STEPPER_DEFAULT = 'rk2'
+    # Multistep GSL steppers, which keep the history of the previous steps so
+    # need solver structures of their own for each instance
+    GSL_MULTISTEP_STEPPERS = ('msadams', 'msbdf')
+    # Whether the last adaptive step size of each instance is used as the
+    # initial step size of its next step
+    GSL_KEEP_STEP_SIZE_DEFAULT = True
     V_THRESHOLD_DEFAULT = 0.0
     MAX_SIMULTANEOUS_TRANSITIONS = 1000
+    # Whether to step the ODEs of all instances on a thread together in
+    # structure-of-arrays form (with fixed-step RK4) instead of individually
+    BATCHED_DEFAULT = False
+    # The solver used for regimes that can't be integrated exactly when the
+    # 'exact' ODE solver is selected
+    EXACT_FALLBACK_ODE_SOLVER = 'gsl'
+    # Whether to locate the times on-condition triggers are crossed within a
+    # timestep by root-finding on the dense output of the ODE step, and the
+    # tolerance (in ms) the times are located to
+    ROOT_FINDING_DEFAULT = False
+    ROOT_TOLERANCE_DEFAULT = 1e-6
+    # Whether to also build a standalone microbenchmark executable,
+    # 'bench_<name>', of the model's update
+    BENCH_DEFAULT = False
+    # Whether to count the work done in the hot path of the update (ODE
+    # steps, transitions, events, etc...) and export it in the 'counters'
+    # status dictionary
+    INSTRUMENT_DEFAULT = False
+    # The 'constant_parameters' option maps parameter names to values fixed at
+    # build time. They are compiled into the generated code as constants, so
+    # the compiler can fold them, and are omitted from Parameters_.
+    CONSTANT_PARAMETERS_DEFAULT = None
+    # Whether to cache the values of aliases between their evaluations in the
+    # dynamics, triggers and transitions of an instance until the states (or
+    # inputs) they depend on change
+    ALIAS_CACHE_DEFAULT = True
+    # Whether to log the times the regime changes (run-length encoding the
+    # regime trace) in the 'regime_log_times/indices' status entries, and
+    # whether to provide recordables of the mean, min and max of each state
+    # variable over the intervals between the recordings of them
+    REGIME_LOG_DEFAULT = True
+    RECORD_REDUCTIONS_DEFAULT = False
+    # Directory in the compile directory the profiles of 'pgo' builds are
+    # recorded in, the marker created once they have been recorded and the
+    # file holding the digest of the sources they were recorded for
+    _PGO_DIR = 'pgo'
+    _PGO_TRAINED = 'trained'
+    _PGO_SOURCES = 'pgo_sources'
     BASE_TMPL_PATH = path.abspath(path.join(path.dirname(__file__),
                                             'templates'))
     UnitHandler = UnitHandler
@@ -59,9 +122,34 @@ class CodeGenerator(BaseCodeGenerator):
         self._compiler = compiler.strip()  # strip trailing \n
 
     def generate_source_files(self, component_class, src_dir, name=None,
-                              debug_print=None, **kwargs):
+                              debug_print=None, module_name=None, **kwargs):
         if name is None:
             name = component_class.name
+        unit_handler = UnitHandler(component_class)
+        ode_solver = kwargs.get('ode_solver', self.ODE_SOLVER_DEFAULT)
+        ss_solver = kwargs.get('ss_solver', self.SS_SOLVER_DEFAULT)
+        if ode_solver is None:
+            raise Pype9BuildError("'ode_solver' cannot be None")
+        gsl_stepper = kwargs.get('gsl_stepper', self.GSL_STEPPER_DEFAULT)
+        if gsl_stepper not in self.GSL_STEPPERS:
+            raise Pype9BuildError(
+                "Unrecognised GSL stepper '{}', can be one of '{}'"
+                .format(gsl_stepper, "', '".join(self.GSL_STEPPERS)))
+        steady_state_cache_size = kwargs.get(
+            'steady_state_cache_size', self.STEADY_STATE_CACHE_SIZE_DEFAULT)
+        if int(steady_state_cache_size) < 1:
+            raise Pype9BuildError(
+                "'steady_state_cache_size' must be at least 1 ({} given)"
+                .format(steady_state_cache_size))
+        # Regimes with linear, constant-coefficient ODEs are integrated with
+        # precalculated propagators and the rest with the fallback solver
+        if ode_solver == 'exact':
+            linear_regimes = self._linear_regimes(component_class,
+                                                  unit_handler)
+            ode_solver = kwargs.get('fallback_ode_solver',
+                                    self.EXACT_FALLBACK_ODE_SOLVER)
+        else:
+            linear_regimes = {}
         # Get the initial regime and check that it refers to a regime in the
         # component class
         tmpl_args = {
@@ -69,10 +157,14 @@ class CodeGenerator(BaseCodeGenerator):
             'component_class': component_class,
             'version': pype9.__version__, 'src_dir': src_dir,
             'timestamp': datetime.now().strftime('%a %d %b %y %I:%M:%S%p'),
-            'unit_handler': UnitHandler(component_class),
+            'unit_handler': unit_handler,
             'sorted_regimes': sorted(
                 component_class.regimes,
                 key=lambda r: component_class.index_of(r)),
+            'gsl_stepper': gsl_stepper,
+            'gsl_multistep': gsl_stepper in self.GSL_MULTISTEP_STEPPERS,
+            'gsl_keep_step_size': kwargs.get(
+                'gsl_keep_step_size', self.GSL_KEEP_STEP_SIZE_DEFAULT),
             'jacobian_approx_step': kwargs.get(
                 'jacobian_approx_step', self.GSL_JACOBIAN_APPROX_STEP_DEFAULT),
             'max_step_size': kwargs.get('max_step_size',
@@ -81,17 +173,41 @@ class CodeGenerator(BaseCodeGenerator):
                                         self.ABS_TOLERANCE_DEFAULT),
             'rel_tolerance': kwargs.get('max_step_size',
                                         self.REL_TOLERANCE_DEFAULT),
+            'steady_state_cache_size': int(steady_state_cache_size),
             'max_simultaneous_transitions': kwargs.get(
                 'max_simultaneous_transitions',
                 self.MAX_SIMULTANEOUS_TRANSITIONS),
             'parameter_scales': [],
             'v_threshold': kwargs.get('v_threshold', self.V_THRESHOLD_DEFAULT),
             'regime_varname': self.REGIME_VARNAME,
+            'batched': kwargs.get('batched', self.BATCHED_DEFAULT),
+            'instrument': kwargs.get('instrument', self.INSTRUMENT_DEFAULT),
+            'regime_log': kwargs.get('regime_log', self.REGIME_LOG_DEFAULT),
+            'record_reductions': kwargs.get('record_reductions',
+                                            self.RECORD_REDUCTIONS_DEFAULT),
+            'ode_solver': ode_solver,
+            'linear_regimes': linear_regimes,
+            'summed_event_ports': self._summed_event_ports(component_class),
+            'constant_parameters': self._constant_parameters(
+                component_class, unit_handler,
+                kwargs.get('constant_parameters',
+                           self.CONSTANT_PARAMETERS_DEFAULT)),
+            'cached_aliases': (
+                self._cached_aliases(component_class)
+                if kwargs.get('alias_cache', self.ALIAS_CACHE_DEFAULT)
+                else {}),
+            'jacobians': (
+                self._jacobians(component_class, unit_handler,
+                                exclude=linear_regimes)
+                if kwargs.get('analytic_jacobian',
+                              self.ANALYTIC_JACOBIAN_DEFAULT) else {}),
+            'root_functions': (
+                self._root_functions(component_class)
+                if kwargs.get('root_finding', self.ROOT_FINDING_DEFAULT)
+                else {}),
+            'root_tolerance': kwargs.get('root_tolerance',
+                                         self.ROOT_TOLERANCE_DEFAULT),
             'debug_print': [] if debug_print is None else debug_print}
-        ode_solver = kwargs.get('ode_solver', self.ODE_SOLVER_DEFAULT)
-        ss_solver = kwargs.get('ss_solver', self.SS_SOLVER_DEFAULT)
-        if ode_solver is None:
-            raise Pype9BuildError("'ode_solver' cannot be None")
         switches = {'ode_solver': ode_solver, 'ss_solver': ss_solver}
         # Render C++ header file
         self.render_to_file('header.tmpl', tmpl_args,
@@ -100,6 +216,21 @@ class CodeGenerator(BaseCodeGenerator):
         self.render_to_file('main.tmpl', tmpl_args, name + '.cpp',
                              src_dir, switches=switches,
                              post_hoc_subs=self._inline_random_implementations)
+        # Models built as part of a batch are registered by the module of
+        # the batch (see generate_module_files)
+        if module_name is None:
+            self.generate_module_files(name, [name], src_dir)
+        # Render the standalone microbenchmark
+        if kwargs.get('bench', self.BENCH_DEFAULT):
+            self.render_to_file('bench.tmpl', tmpl_args,
+                                 'bench_' + name + '.cpp', src_dir)
+
+    def generate_module_files(self, name, component_names, src_dir):
+        tmpl_args = {
+            'component_name': name,
+            'component_names': component_names,
+            'version': pype9.__version__,
+            'timestamp': datetime.now().strftime('%a %d %b %y %I:%M:%S%p')}
         # Render Loader header file
         self.render_to_file('module-header.tmpl', tmpl_args,
                              name + 'Module.h', src_dir)
@@ -111,23 +242,381 @@ class CodeGenerator(BaseCodeGenerator):
                              name + 'Module-init.sli',
                              path.join(src_dir, 'sli'))
 
+    def _linear_regimes(self, component_class, unit_handler):
+        """
+        Finds the regimes whose time derivatives form a linear system with
+        constant coefficients, dy/dt = A * y + b, where A only depends on
+        parameters and constants and b is fixed over a timestep, so can be
+        integrated exactly by precalculated propagator matrices
+
+        Parameters
+        ----------
+        component_class : nineml.Dynamics
+            The component class to find the linear regimes of
+        unit_handler : UnitHandler
+            The unit handler used to scale the time derivatives
+
+        Returns
+        -------
+        linear_regimes : dict(str, dict(str, list))
+            C++ expressions for the coefficients, 'A' (None for zero
+            coefficients), and the inhomogeneous terms, 'b', of each linear
+            regime indexed by regime name
+        """
+        t = sympy.Symbol('t')
+        aliases = dict(
+            (sympy.Symbol(a.name), unit_handler.scale_alias(a)[0].rhs)
+            for a in component_class.aliases)
+        varying = set(sympy.Symbol(n)
+                      for n in component_class.state_variable_names)
+        varying.update(sympy.Symbol(p.name) for p in chain(
+            component_class.analog_receive_ports,
+            component_class.analog_reduce_ports))
+        varying.add(t)
+        linear_regimes = {}
+        for regime in component_class.regimes:
+            if not regime.num_time_derivatives:
+                continue
+            tds = list(regime.time_derivatives)
+            ys = [sympy.Symbol(td.variable) for td in tds]
+            A = []
+            b = []
+            for td in tds:
+                rhs = unit_handler.scale_time_derivative(td)[0].rhs
+                # Substitute (potentially nested) aliases
+                while rhs.free_symbols & set(aliases):
+                    rhs = rhs.xreplace(aliases)
+                row = [sympy.simplify(sympy.diff(rhs, y)) for y in ys]
+                term = sympy.simplify(rhs.xreplace(dict((y, 0) for y in ys)))
+                if (any(c.free_symbols & varying for c in row) or
+                        term.free_symbols & (set(ys) | set([t])) or
+                        sympy.simplify(rhs - term - sum(
+                            c * y for c, y in zip(row, ys))) != 0):
+                    break
+                A.append([None if c == 0 else Expression(c).rhs_cstr
+                          for c in row])
+                b.append(Expression(term).rhs_cstr)
+            else:
+                linear_regimes[regime.name] = {'A': A, 'b': b}
+                continue
+            logger.info("Regime '{}' of {} is not linear, falling back to "
+                        "its ODE solver".format(regime.name,
+                                                component_class.name))
+        return linear_regimes
+
+    def _jacobians(self, component_class, unit_handler, exclude=()):
+        """
+        Differentiates the time derivatives of each regime symbolically with
+        respect to its state variables and time, to provide the solver with an
+        analytic Jacobian. Regimes with derivatives that can't be expressed in
+        C (e.g. containing Dirac deltas from discontinuous functions) fall back
+        to a finite-difference approximation
+
+        Parameters
+        ----------
+        component_class : nineml.Dynamics
+            The component class to calculate the Jacobians of
+        unit_handler : UnitHandler
+            The unit handler used to scale the time derivatives
+        exclude : iterable(str)
+            Names of regimes that don't require a Jacobian (e.g. those that
+            are integrated exactly)
+
+        Returns
+        -------
+        jacobians : dict(str, dict(str, list))
+            C++ expressions for the partial derivatives with respect to the
+            states of the regime, 'dfdy', and time, 'dfdt', (None for zero
+            derivatives) indexed by regime name
+        """
+        t = sympy.Symbol('t')
+        aliases = dict(
+            (sympy.Symbol(a.name), unit_handler.scale_alias(a)[0].rhs)
+            for a in component_class.aliases)
+        unsupported = (sympy.Derivative, sympy.Subs, sympy.DiracDelta)
+        jacobians = {}
+        for regime in component_class.regimes:
+            if not regime.num_time_derivatives or regime.name in exclude:
+                continue
+            tds = list(regime.time_derivatives)
+            ys = [sympy.Symbol(td.variable) for td in tds]
+            dfdy = []
+            dfdt = []
+            for td in tds:
+                rhs = unit_handler.scale_time_derivative(td)[0].rhs
+                # Substitute (potentially nested) aliases
+                while rhs.free_symbols & set(aliases):
+                    rhs = rhs.xreplace(aliases)
+                row = [sympy.diff(rhs, y) for y in ys] + [sympy.diff(rhs, t)]
+                if any(d.has(*unsupported) for d in row):
+                    break
+                row = [None if d == 0 else Expression(d).rhs_cstr
+                       for d in row]
+                dfdy.append(row[:-1])
+                dfdt.append(row[-1])
+            else:
+                jacobians[regime.name] = {'dfdy': dfdy, 'dfdt': dfdt}
+                continue
+            logger.info("Could not differentiate the time derivatives of "
+                        "regime '{}' of {}, falling back to a finite-"
+                        "difference Jacobian".format(regime.name,
+                                                     component_class.name))
+        return jacobians
+
+    def _constant_parameters(self, component_class, unit_handler,
+                             constant_parameters):
+        """
+        Converts the values of the parameters that are fixed at build time
+        (and so compiled into the generated code as constants instead of
+        being held in the Parameters_ struct of each instance) into C++
+        literals in the internal units of the model
+
+        Parameters
+        ----------
+        component_class : Dynamics
+            The build component class
+        unit_handler : UnitHandler
+            The unit handler used to scale the values
+        constant_parameters : dict(str, nineml.Quantity | float) | None
+            The constant parameters, mapping the parameter names of the build
+            component class to their values. Floats are taken to already be
+            in internal units.
+
+        Returns
+        -------
+        literals : dict(str, str)
+            The C++ literals of the constant parameters
+        """
+        literals = {}
+        if not constant_parameters:
+            return literals
+        connection_params = set(
+            component_class.all_connection_parameter_names())
+        for name, value in constant_parameters.items():
+            # Connection parameters aren't in the parameter names of the cell
+            # so are checked for first
+            if name in connection_params:
+                raise Pype9BuildError(
+                    "Connection parameter '{}' of '{}' cannot be constant as "
+                    "it varies between connections"
+                    .format(name, component_class.name))
+            if name not in component_class.parameter_names:
+                raise Pype9BuildError(
+                    "Constant parameter '{}' is not a parameter of '{}' ('{}')"
+                    .format(name, component_class.name,
+                            "', '".join(component_class.parameter_names)))
+            if hasattr(value, 'quantity'):  # Property
+                value = value.quantity
+            value = float(unit_handler.scale_value(value))
+            if value != value or value in (float('inf'), float('-inf')):
+                raise Pype9BuildError(
+                    "Value of constant parameter '{}' must be finite ({})"
+                    .format(name, value))
+            literals[name] = repr(value)
+        return literals
+
+    def _cached_aliases(self, component_class):
+        """
+        Finds the aliases whose values can be cached between evaluations, i.e.
+        those that (directly or via other aliases) only depend on state
+        variables, parameters, analog input ports and constants and not on
+        time, random variables or connection parameters
+
+        Parameters
+        ----------
+        component_class : nineml.Dynamics
+            The component class to find the cacheable aliases of
+
+        Returns
+        -------
+        cached_aliases : dict(str, set(str))
+            The names of the state variables each cacheable alias depends on
+            (used to determine whether it is invariant over the evaluations of
+            the time derivatives within an ODE step) indexed by alias name
+        """
+        aliases = dict((sympy.Symbol(a.name), sympy.sympify(a.rhs))
+                       for a in component_class.aliases)
+        state_vars = set(component_class.state_variable_names)
+        permitted = (
+            state_vars | set(component_class.constant_names) |
+            (set(component_class.parameter_names) -
+             set(component_class.all_connection_parameter_names())) |
+            set(p.name for p in chain(component_class.analog_receive_ports,
+                                      component_class.analog_reduce_ports)))
+        cached_aliases = {}
+        for symbol, rhs in aliases.items():
+            # Substitute (potentially nested) aliases
+            while rhs.free_symbols & set(aliases):
+                rhs = rhs.xreplace(aliases)
+            names = set(str(s) for s in rhs.free_symbols)
+            if names <= permitted:
+                cached_aliases[str(symbol)] = names & state_vars
+        return cached_aliases
+
+    def _summed_event_ports(self, component_class):
+        """
+        Finds the event receive ports for which the state assignments of all
+        OnEvent transitions are linear in the connection weight (e.g.
+        x = x + weight), so that the weights of the events received in a
+        timestep can be summed and applied in a single transition
+
+        Parameters
+        ----------
+        component_class : nineml.Dynamics
+            The component class to find the summed event ports of
+
+        Returns
+        -------
+        summed_event_ports : set(str)
+            Names of the event receive ports that can be summed
+        """
+        try:
+            conn_param_keys = list(
+                component_class.connection_parameter_set_keys)
+        except AttributeError:
+            return set()  # No connection parameters to sum
+        aliases = dict((sympy.Symbol(a.name), sympy.sympify(a.rhs))
+                       for a in component_class.aliases)
+        summed_event_ports = set()
+        for port in component_class.event_receive_ports:
+            if port.name not in conn_param_keys:
+                continue
+            param_names = list(component_class.connection_parameter_set(
+                port.name).parameter_names)
+            if len(param_names) != 1:
+                continue
+            weight = sympy.Symbol(param_names[0])
+            on_events = [(r, oe) for r in component_class.regimes
+                         for oe in r.on_events
+                         if oe.src_port_name == port.name]
+            if on_events and all(
+                    self._is_linear_in_weight(r, oe, weight, aliases)
+                    for r, oe in on_events):
+                summed_event_ports.add(port.name)
+        return summed_event_ports
+
+    @classmethod
+    def _is_linear_in_weight(cls, regime, on_event, weight, aliases):
+        """
+        Checks whether applying an OnEvent once for the summed weight of a
+        set of events is equivalent to applying it once for each event, i.e.
+        it doesn't change regime or emit events and each state assignment
+        increments its state variable by a multiple of the weight that doesn't
+        depend on the assigned state variables
+        """
+        if (on_event.target_regime.name != regime.name or
+                on_event.num_output_events):
+            return False
+        assigned = set(sympy.Symbol(sa.variable)
+                       for sa in on_event.state_assignments)
+        for sa in on_event.state_assignments:
+            rhs = sympy.sympify(sa.rhs)
+            # Substitute (potentially nested) aliases
+            while rhs.free_symbols & set(aliases):
+                rhs = rhs.xreplace(aliases)
+            increment = rhs - sympy.Symbol(sa.variable)
+            coeff = sympy.diff(increment, weight)
+            if (increment.free_symbols & assigned or weight in
+                    coeff.free_symbols or sympy.simplify(
+                        increment.xreplace({weight: 0})) != 0):
+                return False
+        return True
+
+    def _root_functions(self, component_class):
+        """
+        Converts the triggers of the on-conditions that can't be solved for
+        their crossing times explicitly into root functions, which are
+        positive where the trigger is true. Relational expressions become
+        differences of their operands and logical expressions are combined
+        with min (and), max (or) and negation (not), e.g.
+        (a > b) & (c < d) ==> min(a - b, d - c)
+
+        Parameters
+        ----------
+        component_class : nineml.Dynamics
+            The component class to convert the triggers of
+
+        Returns
+        -------
+        root_functions : dict(str, str)
+            C expressions of root functions keyed by the name of the generated
+            on-condition class
+        """
+        root_functions = {}
+        for regime in component_class.regimes:
+            for on_condition in regime.on_conditions:
+                if on_condition.trigger.crossing_time_expr is not None:
+                    continue  # The crossing time can be calculated exactly
+                root_function = self._root_function_cstr(
+                    on_condition.trigger.rhs)
+                if root_function is not None:
+                    root_functions['{}OnCondition{}'.format(
+                        regime.name,
+                        regime.index_of(on_condition))] = root_function
+        return root_functions
+
+    @classmethod
+    def _root_function_cstr(cls, expr):
+        """
+        Recursively converts a trigger expression into the C expression of a
+        root function, returning None if it contains terms that can't be
+        converted (e.g. boolean constants)
+        """
+        if isinstance(expr, (sympy.StrictGreaterThan, sympy.GreaterThan)):
+            return '({})'.format(Expression(expr.lhs - expr.rhs).rhs_cstr)
+        elif isinstance(expr, (sympy.StrictLessThan, sympy.LessThan)):
+            return '({})'.format(Expression(expr.rhs - expr.lhs).rhs_cstr)
+        elif isinstance(expr, (sympy.And, sympy.Or)):
+            args = [cls._root_function_cstr(a) for a in expr.args]
+            if None in args:
+                return None
+            func = 'std::min' if isinstance(expr, sympy.And) else 'std::max'
+            return reduce(lambda a, b: '{}({}, {})'.format(func, a, b), args)
+        elif isinstance(expr, sympy.Not):
+            arg = cls._root_function_cstr(expr.args[0])
+            return '(-{})'.format(arg) if arg is not None else None
+        else:
+            return None
+
     def configure_build_files(self, name, src_dir, compile_dir, install_dir,
-                              **kwargs):  # @UnusedVariable
+                              component_names=None, **kwargs):  # @UnusedVariable @IgnorePep8
+        # The CMakeLists.txt is rendered as the build options may have
+        # changed, in which case make reruns cmake itself (it is left
+        # untouched otherwise)
+        config_args = {'name': name, 'src_dir': src_dir,
+                       'component_names': (
+                           [name] if component_names is None
+                           else component_names),
+                       # NB: ODE solver currently ignored
+                       # 'ode_solver': kwargs.get('ode_solver',
+                       #                          self.ODE_SOLVER_DEFAULT),
+                       'version': pype9.__version__,
+                       'batched': kwargs.get('batched',
+                                             self.BATCHED_DEFAULT),
+                       'bench': kwargs.get('bench', self.BENCH_DEFAULT),
+                       'build_profile': self._build_profile(**kwargs),
+                       'executable': sys.executable}
+        self.render_to_file('CMakeLists.txt.tmpl', config_args,
+                             'CMakeLists.txt', src_dir, only_if_changed=True)
+        if not path.exists(compile_dir):
+            os.mkdir(compile_dir)
+        # Profiles recorded for previous sources are stale
+        digest = self._sources_digest(src_dir)
+        digest_path = path.join(compile_dir, self._PGO_SOURCES)
+        try:
+            with open(digest_path) as f:
+                sources_changed = f.read() != digest
+        except IOError:
+            sources_changed = True
+        if sources_changed:
+            remove_ignore_missing(path.join(compile_dir, self._PGO_DIR))
+            with open(digest_path, 'w') as f:
+                f.write(digest)
         # Generate Makefile if it is not present
         if not path.exists(path.join(compile_dir, 'Makefile')):
-            if not path.exists(compile_dir):
-                os.mkdir(compile_dir)
             logger.info("Configuring build files in '{}' directory"
                         .format(compile_dir))
             orig_dir = os.getcwd()
-            config_args = {'name': name, 'src_dir': src_dir,
-                           # NB: ODE solver currently ignored
-                           # 'ode_solver': kwargs.get('ode_solver',
-                           #                          self.ODE_SOLVER_DEFAULT),
-                           'version': pype9.__version__,
-                           'executable': sys.executable}
-            self.render_to_file('CMakeLists.txt.tmpl', config_args,
-                                 'CMakeLists.txt', src_dir)
             os.chdir(compile_dir)
             stdout, stderr = self.run_command(
                 ['cmake',
@@ -145,8 +634,53 @@ class CodeGenerator(BaseCodeGenerator):
                              .format(compile_dir, stdout, stderr))
             os.chdir(orig_dir)
 
-    def compile_source_files(self, compile_dir, component_name):
-        # Run configure script, make and make install
+    @classmethod
+    def _sources_digest(cls, src_dir):
+        """
+        Returns a digest of the generated source files (other than the build
+        files), which is used to determine whether the profiles recorded for
+        'pgo' builds still apply
+        """
+        digest = hashlib.sha256()
+        for dpath, dnames, fnames in sorted(os.walk(src_dir)):
+            dnames.sort()
+            for fname in sorted(fnames):
+                fpath = path.join(dpath, fname)
+                if fname == 'CMakeLists.txt' or fpath.endswith('.pyc'):
+                    continue
+                digest.update(path.relpath(fpath, src_dir).encode('utf-8'))
+                with open(fpath, 'rb') as f:
+                    digest.update(f.read())
+        return digest.hexdigest()
+
+    def compile_source_files(self, compile_dir, component_name,
+                             install_dir=None, component_names=None,
+                             **kwargs):
+        """
+        Compiles and installs the module. With the 'pgo' build profile the
+        module is first built instrumented and trained (see _train_pgo) if
+        there isn't a profile for the current sources, and then rebuilt using
+        the recorded profile.
+        """
+        pgo_dir = path.join(compile_dir, self._PGO_DIR)
+        if (self._build_profile(**kwargs) == 'pgo' and
+                not path.exists(path.join(pgo_dir, self._PGO_TRAINED))):
+            if install_dir is None:
+                raise Pype9BuildError(
+                    "Install directory is required for 'pgo' builds")
+            self._set_pgo_stage(compile_dir, 'generate')
+            self._make(compile_dir, component_name)
+            self._train_pgo(
+                component_name,
+                [component_name] if component_names is None
+                else component_names,
+                compile_dir, install_dir, kwargs.get('pgo_command', None))
+            open(path.join(pgo_dir, self._PGO_TRAINED), 'w').close()
+            self._set_pgo_stage(compile_dir, 'use')
+        self._make(compile_dir, component_name)
+
+    def _make(self, compile_dir, component_name):
+        # Run make and make install
         os.chdir(compile_dir)
         logger.info("Compiling NEST model class in '{}' directory."
                     .format(compile_dir))
@@ -176,6 +710,60 @@ class CodeGenerator(BaseCodeGenerator):
         logger.info("Compilation of '{}' NEST module completed "
                     "successfully".format(component_name))
 
+    def _set_pgo_stage(self, compile_dir, stage):
+        """
+        Reconfigures the build for the given stage ('generate' or 'use') of a
+        profile-guided optimisation build, which make then rebuilds with the
+        changed flags
+        """
+        os.chdir(compile_dir)
+        self.run_command(
+            ['cmake', '-DPYPE9_PGO={}'.format(stage), '.'],
+            fail_msg=("Could not reconfigure '{}' for the '{}' stage of the "
+                      "profile-guided build: {{}}".format(compile_dir, stage)))
+
+    def _train_pgo(self, name, component_names, compile_dir, install_dir,
+                   pgo_command=None):
+        """
+        Runs the instrumented module to record the profile for the profile-
+        guided build, either with a user-supplied training command or by
+        simulating a population of each model driven by Poisson spike trains
+        (see pgo_train.py). The command is run with the module's library
+        directory on the library path and PYPE9_PGO_MODULE, PYPE9_PGO_MODELS
+        and PYPE9_PGO_INSTALL_DIR set in its environment.
+        """
+        if pgo_command is None:
+            pgo_command = [sys.executable,
+                           path.join(path.dirname(__file__), 'pgo_train.py')]
+        elif isinstance(pgo_command, basestring):
+            pgo_command = pgo_command.split()
+        env = os.environ.copy()
+        lib_dir = path.join(install_dir, 'lib')
+        env['LD_LIBRARY_PATH'] = os.pathsep.join(
+            p for p in (lib_dir, env.get('LD_LIBRARY_PATH')) if p)
+        env['PYPE9_PGO_MODULE'] = name + 'Module'
+        env['PYPE9_PGO_MODELS'] = ','.join(component_names)
+        env['PYPE9_PGO_INSTALL_DIR'] = install_dir
+        logger.info("Training profile-guided build of '{}' with '{}'"
+                    .format(name, ' '.join(pgo_command)))
+        try:
+            sp.check_call(pgo_command, env=env, cwd=compile_dir)
+        except (sp.CalledProcessError, OSError) as e:
+            raise Pype9BuildError(
+                "Training run of profile-guided build of '{}' failed: {}"
+                .format(name, e))
+        # Clang records raw profiles that need to be merged before use
+        pgo_dir = path.join(compile_dir, self._PGO_DIR)
+        profraws = [path.join(pgo_dir, f) for f in os.listdir(pgo_dir)
+                    if f.endswith('.profraw')]
+        if profraws:
+            self.run_command(
+                ['llvm-profdata', 'merge',
+                 '-output={}'.format(path.join(pgo_dir, 'default.profdata'))] +
+                profraws,
+                fail_msg=("Could not merge the profiles of '{}': {{}}"
+                          .format(name)))
+
     def clean_src_dir(self, src_dir, name):
         # Clean existing src directories from previous builds.
         prefix = path.join(src_dir, name)
@@ -184,6 +772,7 @@ class CodeGenerator(BaseCodeGenerator):
             remove_ignore_missing(prefix + '.cpp')
             remove_ignore_missing(prefix + 'Module.h')
             remove_ignore_missing(prefix + 'Module.cpp')
+            remove_ignore_missing(path.join(src_dir, 'bench_' + name + '.cpp'))
             remove_ignore_missing(
                 path.join(src_dir, 'sli', name + 'Module-init.sli'))
         sli_path = path.join(src_dir, 'sli')
@@ -227,12 +816,30 @@ class CodeGenerator(BaseCodeGenerator):
             logger.debug("make clean '{}':\nstdout:\n{}stderr:\n{}\n"
                          .format(compile_dir, stdout, stderr))
 
+    def get_compiler(self):
+        return self._compiler
+
     def simulator_specific_paths(self):
         path = []
         if 'NEST_INSTALL_DIR' in os.environ:
             path.append(path.join(os.environ['NEST_INSTALL_DIR'], 'bin'))
         return path
 
+    def get_bench_path(self, name, url):
+        """
+        Returns the path of the standalone microbenchmark of the model, which
+        is installed when it is built with the 'bench' option
+
+        Parameters
+        ----------
+        name : str
+            Name of the generated model
+        url : str
+            URL of the file the component class was loaded from
+        """
+        return path.join(self.get_install_dir(name, url), 'bin',
+                         'bench_' + name)
+
     def load_libraries(self, name, url, **kwargs):  # @UnusedVariable
         install_dir = self.get_install_dir(name, url)
         lib_dir = os.path.join(install_dir, 'lib')
@@ -0,0 +1,40 @@
+"""
+  Default training run of profile-guided ('pgo') builds of generated NEST
+  modules, which simulates a population of each model in the module driven by
+  Poisson spike trains on each of its receptors so that the instrumented
+  module records a profile of a typical update. It is run in a separate
+  process by the code generator with the module and models to train given by
+  the PYPE9_PGO_MODULE, PYPE9_PGO_MODELS and PYPE9_PGO_INSTALL_DIR
+  environment variables.
+
+  Author: Thomas G. Close (tclose@oist.jp)
+  Copyright: 2012-2014 Thomas G. Close.
+  License: This file is part of the "NineLine" package, which is released under
+           the MIT Licence, see LICENSE for details.
+"""
+import os
+import nest
+
+NUM_NEURONS = 100
+SIM_TIME = 1000.0  # ms
+SPIKE_RATE = 100.0  # Hz
+
+
+def train():
+    install_dir = os.environ['PYPE9_PGO_INSTALL_DIR']
+    nest.sli_run('({}) addpath'.format(
+        os.path.join(install_dir, 'share', 'sli')))
+    nest.Install(os.environ['PYPE9_PGO_MODULE'])
+    for model in os.environ['PYPE9_PGO_MODELS'].split(','):
+        nodes = nest.Create(model, NUM_NEURONS)
+        receptors = nest.GetDefaults(model).get('receptor_types', {})
+        for receptor in receptors.values():
+            generator = nest.Create('poisson_generator',
+                                    params={'rate': SPIKE_RATE})
+            nest.Connect(generator, nodes,
+                         syn_spec={'receptor_type': receptor})
+    nest.Simulate(SIM_TIME)
+
+
+if __name__ == '__main__':
+    train()
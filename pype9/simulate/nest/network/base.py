@@ -8,8 +8,9 @@
            the MIT Licence, see LICENSE for details.
 """
 from __future__ import absolute_import
+import nineml.units as un
 import sys
-from pype9.exceptions import Pype9RuntimeError
+from pype9.exceptions import Pype9RuntimeError, Pype9UsageError
 # Remove any system arguments that may conflict with
 if '--debug' in sys.argv:
     raise Pype9RuntimeError(
@@ -27,6 +28,10 @@ from .connectivity import PyNNConnectivity  # @IgnorePep8
 from ..code_gen import CodeGenerator as CodeGenerator  # @IgnorePep8
 from ..units import UnitHandler  # @IgnorePep8
 from ..simulation import Simulation  # @IgnorePep8
+from ..cells.base import _get_counters, _reset_counters  # @IgnorePep8
+import nest  # @IgnorePep8
+import numpy as np  # @IgnorePep8
+import quantities as pq  # @IgnorePep8
 
 
 (get_current_time, get_time_step,
@@ -53,11 +58,119 @@ class ComponentArray(BaseComponentArray, pyNN.nest.Population):
     def _min_delay(self):
         return get_min_delay()
 
-    def record(self, port_name):
+    @property
+    def counters(self):
+        """
+        The counters of the work done in the update of each local cell in the
+        array (see Cell.counters). Requires the cells to be built with the
+        'instrument' option
+        """
+        return _get_counters([int(c) for c in self.local_cells])
+
+    def reset_counters(self):
+        """
+        Resets the counters of each local cell in the array. Requires the
+        cells to be built with the 'instrument' option
+        """
+        _reset_counters([int(c) for c in self.local_cells])
+
+    def _get_columns(self, names):
+        # A single GetStatus call for all local cells and variables
+        values = nest.GetStatus([int(c) for c in self.local_cells],
+                                keys=list(names))
+        return np.asarray(values, dtype=float).reshape(
+            (len(values), len(names))).T
+
+    def _set_columns(self, columns):
+        # A single SetStatus call for all local cells and variables
+        nest.SetStatus(
+            [int(c) for c in self.local_cells],
+            [dict((n, float(v[i])) for n, v in columns.items())
+             for i in range(len(self.local_cells))])
+
+    def _get_regimes(self):
+        # The current regimes are exported by their names
+        regime_varname = self.celltype.model.code_generator.REGIME_VARNAME
+        return np.array(
+            [self.celltype.model.regime_index(n) for n in nest.GetStatus(
+                [int(c) for c in self.local_cells], keys=regime_varname)],
+            dtype=int)
+
+    def _set_regimes(self, indices):
+        nest.SetStatus(
+            [int(c) for c in self.local_cells],
+            self.celltype.model.code_generator.REGIME_VARNAME,
+            [int(i) for i in indices])
+
+    def _get_trigger_flags(self):
+        flags = nest.GetStatus([int(c) for c in self.local_cells],
+                               keys='trigger_flags')
+        return np.asarray(flags, dtype=int).reshape((len(flags), -1))
+
+    def _set_trigger_flags(self, flags):
+        if flags.shape[1]:
+            nest.SetStatus([int(c) for c in self.local_cells],
+                           [{'trigger_flags': [int(f) for f in row]}
+                            for row in flags])
+
+    def _play_analog(self, port_name, signal):
+        # As for single cells, the device delay is subtracted from the times
+        # of the signal so that its effect aligns with other simulators. The
+        # generator is created on every process and connected to all the
+        # cells, of which only the local ones are connected by NEST
+        delay = Simulation.active().device_delay_ms
+        t_start = float(signal.t_start.rescale(pq.ms)) - delay
+        if t_start <= 0.0:
+            raise Pype9UsageError(
+                "Start time of signal played into port '{}' ({}) must be "
+                "greater than device delay ({} ms)".format(
+                    port_name, signal.t_start, delay))
+        generator = nest.Create('step_current_generator', 1, {
+            'amplitude_values': list(np.ravel(pq.Quantity(signal, 'pA'))),
+            'amplitude_times': list(np.ravel(np.asarray(
+                signal.times.rescale(pq.ms))) - delay),
+            'start': t_start,
+            'stop': float(signal.t_stop.rescale(pq.ms))})
+        nest.Connect(generator, [int(c) for c in self.all_cells], syn_spec={
+            'receptor_type': self.celltype.get_receptor_type(port_name),
+            'delay': delay})
+        return generator
+
+    @property
+    def _stream_delay(self):
+        return self._min_delay
+
+    def _create_stream_sources(self, port_name, weight):
+        # Devices are created on every process so a generator is created for
+        # each cell of the array, of which only the replicas on the process
+        # the target cell is local to are connected and fed
+        generators = nest.Create('spike_generator', self.size)
+        nest.Connect(generators, [int(c) for c in self.all_cells],
+                     'one_to_one', syn_spec={
+                         'receptor_type': self.celltype.get_receptor_type(
+                             port_name),
+                         'delay': self._min_delay, 'weight': weight})
+        return generators
+
+    def _feed_stream_sources(self, sources, indices, times):
+        # The previous spike times of the generators are all in the past so
+        # they can be replaced by the ones in the next segment
+        order = np.argsort(indices, kind='mergesort')
+        indices, times = indices[order], times[order]
+        cells, starts = np.unique(indices, return_index=True)
+        nest.SetStatus(
+            [sources[i] for i in cells],
+            [{'spike_times': [float(t) for t in ts]}
+             for ts in np.split(times, starts[1:])])
+
+    def record(self, port_name, interval=None):
         communicates, to_record = self._get_port_details(port_name)
         if communicates == 'event':
             to_record = 'spikes'  # FIXME: Need a way of differentiating event send ports @IgnorePep8
-        pyNN.nest.Population.record(self, to_record)
+        if interval is not None:
+            interval = float(interval.in_units(un.ms))
+        pyNN.nest.Population.record(self, to_record,
+                                    sampling_interval=interval)
 
 
 class Selection(BaseSelection, pyNN.nest.Assembly):
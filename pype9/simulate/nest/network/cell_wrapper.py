@@ -45,11 +45,14 @@ class PyNNCellWrapperMetaClass(BasePyNNCellWrapperMetaClass):
     """
 
     loaded_celltypes = {}
+    CellMetaClass = CellMetaClass
 
     def __new__(cls, component_class, default_properties,
                 initial_state, initial_regime, **kwargs):  # @UnusedVariable
         # Get the basic Pype9 cell class
-        model = CellMetaClass(component_class=component_class)
+        model = CellMetaClass(**cls._model_kwargs(
+            component_class, default_properties, initial_state,
+            initial_regime, **kwargs))
         try:
             celltype = cls.loaded_celltypes[model.name]
         except (KeyError, Pype9BuildMismatchError):
@@ -63,3 +66,12 @@ class PyNNCellWrapperMetaClass(BasePyNNCellWrapperMetaClass):
                 cls, model.name, (PyNNCellWrapper,), dct)
             cls.loaded_celltypes[model.name] = celltype
         return celltype
+
+    @classmethod
+    def _model_kwargs(cls, component_class, default_properties,
+                      initial_state, initial_regime, **kwargs):  # @UnusedVariable @IgnorePep8
+        """
+        The keyword arguments the cell class of the cell type is created with
+        """
+        kwargs['component_class'] = component_class
+        return kwargs
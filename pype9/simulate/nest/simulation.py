@@ -15,7 +15,9 @@ class Simulation(BaseSimulation):
 
     def __init__(self, *args, **kwargs):
         self._device_delay = kwargs.get('device_delay', None)
-        self._threads_per_proc = kwargs.get('threads_per_proc', 1)
+        # 'threads_per_proc' was the NEST-specific name of 'num_threads'
+        if 'threads_per_proc' in kwargs:
+            kwargs.setdefault('num_threads', kwargs.pop('threads_per_proc'))
         super(Simulation, self).__init__(*args, **kwargs)
 
     @property
@@ -73,6 +75,7 @@ class Simulation(BaseSimulation):
         pyNN_setup(timestep=float(self.dt.in_units(un.ms)),
                    min_delay=float(min_delay.in_units(un.ms)),
                    max_delay=float(max_delay.in_units(un.ms)),
+                   threads=self.threads_per_process,
                    grng_seed=self.global_seed,
                    rng_seeds=self.all_dynamics_seeds, **kwargs)
 
@@ -84,10 +87,6 @@ class Simulation(BaseSimulation):
         "The number of MPI processes"
         return pyNN_state.num_processes
 
-    def num_threads(self):
-        "The total number of threads across all MPI nodes"
-        return self.num_processes() * self._threads_per_proc
-
     @classmethod
     def quit(cls):
         "Gracefully quit the simulator"
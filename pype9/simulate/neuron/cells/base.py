@@ -25,6 +25,8 @@ from nineml.exceptions import NineMLNameError
 from nineml.visitors import BaseVisitorWithContext
 from math import pi
 from pype9.simulate.common.cells import base
+from pype9.simulate.common.recording import (
+    StreamedSpikeInput, StreamedAnalogInput)
 from pype9.simulate.neuron.units import UnitHandler
 from pype9.simulate.neuron.simulation import Simulation
 from pype9.annotations import (
@@ -240,6 +242,26 @@ class Cell(base.Cell):
     def _set_regime(self):
         setattr(self._hoc, self.code_generator.REGIME_VARNAME, self._regime_index)
 
+    def _set_rng_stream(self, stream):
+        """
+        Sets the id of the stream of libninemlnrn's counter-based generator
+        that the random processes of the cell are drawn from
+
+        Parameters
+        ----------
+        stream : int
+            The id of the stream (e.g. the gid of the cell)
+        """
+        if self.build_component_class.annotations.get(
+                (BUILD_TRANS, PYPE9_NS), MECH_TYPE) == ARTIFICIAL_CELL_MECH:
+            seed = getattr(self._hoc, self.code_generator.SEED_VARNAME)
+            if hasattr(seed, 'set_ids'):
+                # Random123 stream of CoreNEURON-compatible mechanisms, which
+                # is identified by three unsigned ints
+                seed.set_ids(abs(stream), int(stream < 0), 0)
+            else:
+                setattr(self._hoc, self.code_generator.SEED_VARNAME, stream)
+
     def record(self, port_name, **kwargs):  # @UnusedVariable
         """
         Parameters
@@ -353,15 +375,19 @@ class Cell(base.Cell):
         ----------
         port_name : str
             The name of the receive port to play the signal into
-        signal : neo.AnalogSignal (current) | neo.SpikeTrain
-            Signal to play into the port
+        signal : neo.AnalogSignal (current) | neo.SpikeTrain |
+                 StreamedSpikeInput
+            Signal to play into the port. Streamed spikes are read from file
+            segment by segment as the simulation advances
         properties : list(nineml.Property)
             The connection properties of the event port
         """
         ext_is = self.build_component_class.annotations.get(
             (BUILD_TRANS, PYPE9_NS), EXTERNAL_CURRENTS).split(',')
         port = self.component_class.port(port_name)
-        if isinstance(port, EventPort):
+        if isinstance(signal, (StreamedSpikeInput, StreamedAnalogInput)):
+            self._play_stream(port_name, port, signal, properties)
+        elif isinstance(port, EventPort):
             if len(list(self.component_class.event_receive_ports)) > 1:
                 raise Pype9Unsupported9MLException(
                     "Multiple event receive ports ('{}') are not currently "
@@ -401,6 +427,42 @@ class Cell(base.Cell):
             self._inputs['iclamp'] = iclamp
             self._input_auxs.extend((iclamp_amps, iclamp_times))
 
+    def _play_stream(self, port_name, port, stream, properties):
+        if not isinstance(stream, StreamedSpikeInput):
+            # The vectors played into the IClamp can't be swapped while the
+            # simulation is running
+            raise Pype9Unsupported9MLException(
+                "Streamed analog signals are not supported by the NEURON "
+                "simulator, play the signal in as a neo.AnalogSignal instead")
+        if not isinstance(port, EventPort):
+            raise Pype9UsageError(
+                "Streamed spikes can only be played into event receive ports "
+                "('{}' is not)".format(port_name))
+        if len(list(self.component_class.event_receive_ports)) > 1:
+            raise Pype9Unsupported9MLException(
+                "Multiple event receive ports ('{}') are not currently "
+                "supported".format("', '".join(
+                    p.name
+                    for p in self.component_class.event_receive_ports)))
+        stream.check_start(float(self.Simulation.active().t.in_units(un.ms)),
+                           0.0)
+        # The spikes are queued directly on the NetCon at their arrival times
+        netcon = h.NetCon(None, self._hoc)
+        self._check_connection_properties(port_name, properties)
+        if len(properties) > 1:
+            raise NotImplementedError(
+                "Cannot handle more than one connection property per port")
+        elif properties:
+            netcon.weight[0] = self.unit_handler.scale_value(
+                properties[0].quantity)
+
+        def feed(t_start, t_stop):
+            for t in stream.read(t_start, t_stop)[1]:
+                netcon.event(float(t))
+
+        self._inputs['stream'] = netcon
+        self.Simulation.active().register_input_stream(feed)
+
     def connect(self, sender, send_port_name, receive_port_name,
                 delay=0.0 * un.ms, properties=None):
         """
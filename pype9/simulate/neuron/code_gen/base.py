@@ -19,6 +19,7 @@ from itertools import chain
 import subprocess as sp
 from collections import defaultdict
 import sympy
+from sympy.core.function import AppliedUndef
 import neuron
 import nineml.units as un
 from nineml.abstraction import Alias, AnalogSendPort, Dynamics
@@ -64,6 +65,23 @@ class CodeGenerator(BaseCodeGenerator):
     BASE_TMPL_PATH = os.path.abspath(os.path.join(os.path.dirname(__file__),
                                                   'templates'))
     UnitHandler = UnitHandler
+    # Compile (passed to nrnivmodl with '-incflags') and link flags of each
+    # build profile
+    BUILD_PROFILE_FLAGS = {
+        'debug': (['-O0', '-g'], []),
+        'release': ([], []),
+        'native': (['-O3', '-march=native', '-flto'], ['-flto'])}
+    # Whether to generate mechanisms without VERBATIM blocks (with randomness
+    # drawn from per-instance Random123 streams, requiring NEURON >= 9) that
+    # can also be compiled for and executed by CoreNEURON. NB: The generated
+    # mechanisms are THREADSAFE either way, as the VERBATIM blocks only call
+    # libninemlnrn, which keeps its state per thread and per instance
+    CORENEURON_DEFAULT = False
+    # Whether to update the states of artificial cells in regimes with
+    # closed-form solutions only when they receive events (advancing them
+    # analytically from the last event) instead of every timestep. As their
+    # recorded states then only change at events it is opt-in
+    EVENT_DRIVEN_DEFAULT = False
 
     _neuron_units = {un.mV: 'millivolt',
                      un.S: 'siemens',
@@ -76,9 +94,12 @@ class CodeGenerator(BaseCodeGenerator):
         self.nrnivmodl_path = self.get_neuron_util_path('nrnivmodl')
         self.modlunit_path = self.get_neuron_util_path('modlunit',
                                                        default=None)
-        # Compile wrappers around GSL random distribution functions
+        # Compile wrappers around GSL random distribution functions (again if
+        # they have been updated since they were last compiled)
         if is_mpi_master():
-            if not os.path.exists(self.libninemlnrn_so):
+            if (not os.path.exists(self.libninemlnrn_so) or
+                os.path.getmtime(self.libninemlnrn_so) < os.path.getmtime(
+                    os.path.join(self.BASE_TMPL_PATH, 'ninemlnrn.cpp'))):
                 self.compile_libninemlnrn()
         mpi_comm.barrier()
         self.nrnivmodl_flags = [
@@ -117,12 +138,136 @@ class CodeGenerator(BaseCodeGenerator):
             Whether to use the 'SUFFIX' tag or not.
         ode_solver : str
             specifies the ODE solver to use
+        event_driven : bool
+            Whether to update the states of artificial cells only when they
+            receive events in regimes where they have closed-form solutions
         """
         if name is None:
             name = component_class.name
         template = 'main.tmpl'
+        if kwargs.get('event_driven', self.EVENT_DRIVEN_DEFAULT):
+            event_driven = self._event_driven_regimes(component_class)
+        else:
+            event_driven = {}
         self.generate_mod_file(template, component_class, src_dir, name,
-                               kwargs)
+                               dict(kwargs, event_driven=event_driven))
+
+    def _event_driven_regimes(self, component_class):
+        """
+        Finds the regimes of artificial cells that can be updated only when
+        events are received. Their time derivatives need to be linear in
+        their own state variable, with coefficients that don't depend on
+        time, inputs or the other states with time derivatives (so they have
+        closed-form solutions), and their state-dependent triggers need to
+        compare a single state variable against a threshold (so their
+        crossing times can be calculated from the solutions)
+
+        Parameters
+        ----------
+        component_class : nineml.Dynamics
+            The (transformed) component class to find the event-driven
+            regimes of
+
+        Returns
+        -------
+        event_driven : dict(str, dict)
+            The closed-form solutions of the states, 'states', as tuples of
+            the state variable name, rate constant (None for constant rates of
+            change) and equilibrium value (or rate of change), and the
+            crossings of the triggers, 'triggers', as dictionaries containing
+            the 'state_variable' and its 'rate' and 'value', whether it is
+            crossed from 'below' and the 'threshold' indexed by the trigger
+            expression, for each event-driven regime
+        """
+        if component_class.annotations.get(
+                (BUILD_TRANS, PYPE9_NS), MECH_TYPE) != ARTIFICIAL_CELL_MECH:
+            return {}
+        unit_handler = UnitHandler(component_class)
+        t = sympy.Symbol('t')
+        aliases = dict(
+            (sympy.Symbol(a.name), unit_handler.scale_alias(a)[0].rhs)
+            for a in component_class.aliases)
+        ports = set(sympy.Symbol(p.name) for p in chain(
+            component_class.analog_receive_ports,
+            component_class.analog_reduce_ports))
+
+        def substitute_aliases(expr):
+            # Substitute (potentially nested) aliases
+            while expr.free_symbols & set(aliases):
+                expr = expr.xreplace(aliases)
+            return expr
+
+        event_driven = {}
+        for regime in component_class.regimes:
+            if not regime.num_time_derivatives or regime.num_aliases:
+                continue  # Nothing to solve or aliases overridden
+            odes = set(sympy.Symbol(v)
+                       for v in regime.time_derivative_variables)
+            varying = odes | ports | set([t])
+            states = []
+            solution = {}
+            for td in regime.time_derivatives:
+                x = sympy.Symbol(td.variable)
+                rhs = substitute_aliases(
+                    unit_handler.scale_time_derivative(td)[0].rhs)
+                a = sympy.simplify(sympy.diff(rhs, x))
+                b = sympy.simplify(rhs - a * x)
+                if ((a.free_symbols | b.free_symbols) & varying or
+                        rhs.atoms(AppliedUndef)):
+                    break  # Nonlinear, coupled, driven by inputs or random
+                if a == 0:
+                    states.append((td.variable, None, self.expr_str(b)))
+                    solution[x] = (None, b)
+                else:
+                    x_inf = sympy.simplify(-b / a)
+                    states.append((td.variable, self.expr_str(a),
+                                   self.expr_str(x_inf)))
+                    solution[x] = (a, x_inf)
+            else:
+                triggers = {}
+                for on_condition in regime.on_conditions:
+                    trigger = on_condition.trigger
+                    if trigger.crossing_time_expr is not None:
+                        continue  # Scheduled from the time it is crossed
+                    if not isinstance(trigger.rhs, sympy.relational.Relational):
+                        break
+                    crossing = self._trigger_crossing(
+                        type(trigger.rhs)(*(
+                            substitute_aliases(
+                                unit_handler.scale_expr(arg)[0].rhs)
+                            for arg in trigger.rhs.args)),
+                        solution, varying)
+                    if crossing is None:
+                        break
+                    triggers[trigger.rhs] = crossing
+                else:
+                    event_driven[regime.name] = {'states': states,
+                                                 'triggers': triggers}
+        return event_driven
+
+    def _trigger_crossing(self, trigger, solution, varying):
+        """
+        Returns the state variable, direction and threshold of a trigger
+        of the form 'x > threshold' or 'x < threshold' (or None if it isn't
+        of that form). Thresholds of constant states can still be crossed by
+        the state assignments of input events.
+        """
+        if isinstance(trigger, (sympy.StrictGreaterThan, sympy.GreaterThan)):
+            below = True
+        elif isinstance(trigger, (sympy.StrictLessThan, sympy.LessThan)):
+            below = False
+        else:
+            return None
+        lhs, rhs = trigger.lhs, trigger.rhs
+        if rhs in solution and not lhs.free_symbols & varying:
+            lhs, rhs, below = rhs, lhs, not below
+        if lhs not in solution or rhs.free_symbols & varying:
+            return None
+        a, b = solution[lhs]
+        return {'state_variable': str(lhs), 'below': below,
+                'rate': self.expr_str(a) if a is not None else None,
+                'value': self.expr_str(b),
+                'threshold': self.expr_str(rhs)}
 
     def generate_mod_file(self, template, component_class, src_dir, name,
                           template_args):
@@ -145,7 +290,9 @@ class CodeGenerator(BaseCodeGenerator):
             'external_ports': [],
             'is_subcomponent': True,
             'regime_varname': self.REGIME_VARNAME,
-            'seed_varname': self.SEED_VARNAME}
+            'seed_varname': self.SEED_VARNAME,
+            'coreneuron': self.CORENEURON_DEFAULT,
+            'event_driven': {}}
 #             # FIXME: weight_vars needs to be removed or implemented properly
 #             'weight_variables': []}
         tmpl_args.update(template_args)
@@ -439,7 +586,7 @@ class CodeGenerator(BaseCodeGenerator):
                 expr.subs(ext_i, 0)
                 expr.simplify()
 
-    def compile_source_files(self, compile_dir, name):
+    def compile_source_files(self, compile_dir, name, **kwargs):
         """
         Builds all NMODL files in a directory
 
@@ -478,9 +625,22 @@ class CodeGenerator(BaseCodeGenerator):
                         raise Pype9BuildError(
                             "Could not run 'modlunit' to check dimensions in "
                             "NMODL file: {}\n{}".format(fname, e))
+        # Add the compile and link flags of the build profile
+        build_profile = self._build_profile(**kwargs)
+        if build_profile == 'pgo':
+            logger.warning(
+                "Profile-guided builds are not supported for NEURON, building "
+                "'{}' with the 'native' profile instead".format(name))
+            build_profile = 'native'
+        compile_flags, link_flags = self.BUILD_PROFILE_FLAGS[build_profile]
         # Run nrnivmodl command in src directory
-        nrnivmodl_cmd = [self.nrnivmodl_path, '-loadflags',
-                         ' '.join(self.nrnivmodl_flags)]
+        nrnivmodl_cmd = [self.nrnivmodl_path]
+        if kwargs.get('coreneuron', self.CORENEURON_DEFAULT):
+            nrnivmodl_cmd.append('-coreneuron')
+        if compile_flags:
+            nrnivmodl_cmd.extend(['-incflags', ' '.join(compile_flags)])
+        nrnivmodl_cmd.extend(['-loadflags',
+                              ' '.join(self.nrnivmodl_flags + link_flags)])
         logger.debug("Building nrnivmodl in {} with {}".format(
             compile_dir, nrnivmodl_cmd))
         self.run_command(nrnivmodl_cmd, fail_msg=(
@@ -548,6 +708,11 @@ class CodeGenerator(BaseCodeGenerator):
             pass
         return path
 
+    def expr_str(self, expr):
+        nmodl_str = ccode(Expression.expand_integer_powers(expr),
+                          user_functions=Expression._cfunc_map)
+        return Expression.strip_L_from_rationals(nmodl_str)
+
     def assign_str(self, lhs, rhs):
         rhs = Expression.expand_integer_powers(rhs)
         nmodl_str = ccode(rhs, user_functions=Expression._cfunc_map,
@@ -577,7 +742,8 @@ class CodeGenerator(BaseCodeGenerator):
                        .format(cc, self.BASE_TMPL_PATH,
                                ' '.join('-I{}/include'.format(p)
                                         for p in gsl_prefixes)))
-        os.makedirs(self.libninemlnrn_dir)
+        if not os.path.exists(self.libninemlnrn_dir):
+            os.makedirs(self.libninemlnrn_dir)
         self.run_cmd(
             compile_cmd, work_dir=self.libninemlnrn_dir,
             fail_msg=("Unable to compile libninemlnrn extensions"))
@@ -643,6 +809,9 @@ class CodeGenerator(BaseCodeGenerator):
                     .format(util_name, util_path))
         return util_path
 
+    def get_compiler(self):
+        return self.get_cc()
+
     def get_cc(self):
         """
         Get the C compiler used to compile NMODL files
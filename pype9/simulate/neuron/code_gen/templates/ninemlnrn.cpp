@@ -1,5 +1,5 @@
 /*
- 
+
 A library that wraps GSL random routines for use in mod-files:
 
 gsl_rng* get_gsl_rng()
@@ -11,50 +11,183 @@ double nineml_gsl_binomial(double p, int n);
 double nineml_gsl_exponential(double mu);
 double nineml_gsl_poisson(double mu);
 
+Variates are drawn from a counter-based generator (Philox4x32-10) so that the
+generators don't hold any state that needs to be shared between threads. The
+functions above draw from a stream per thread, whereas the 'nineml_rng_*'
+equivalents, e.g.
+
+double nineml_rng_normal(double stream, double* counter, double m, double s);
+
+draw from the stream of a mechanism instance, keyed on the seed and the id of
+the stream (e.g. the gid of the cell) and positioned by the counter (which is
+advanced by the call and stored in the instance). They are therefore
+reproducible regardless of the order the instances are evaluated in and which
+thread or rank they are evaluated on.
+
+Normal, uniform and exponential variates can also be drawn in batches, e.g.
+
+void nineml_gsl_fill_normal(double* out, size_t n, double m, double s);
+void nineml_rng_fill_normal(double stream, double* counter, double* out,
+                            size_t n, double m, double s);
+
+which generate consecutive blocks of the stream in a loop without
+dependencies between iterations (so the compiler can vectorise it) and
+transform each block into two variates (by Box-Muller for normal variates).
+The scalar normal, uniform and exponential functions of the thread streams
+pop variates from buffers of the calling thread, which are refilled in
+batches.
+
 */
 
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <stdint.h>
+#include <math.h>
 
 #include <gsl/gsl_rng.h>
 #include <gsl/gsl_randist.h>
 
+#if __cplusplus >= 201103L
+#define NINEML_THREAD_LOCAL thread_local
+#else
+#define NINEML_THREAD_LOCAL __thread
+#endif
+
+
+/* PHILOX4x32-10 COUNTER-BASED GENERATOR */
+
+struct nineml_philox_state {
+    uint32_t key[2];
+    uint32_t ctr[4];  // Block counter (ctr[0] low, ctr[1] high) and stream
+    uint32_t buf[4];  // Output of the last block
+    unsigned int pos;  // Next unused word of the output
+};
+
+static inline void nineml_philox_block(const uint32_t ctr_in[4], const uint32_t key_in[2], uint32_t out[4]) {
+    uint32_t c0 = ctr_in[0], c1 = ctr_in[1], c2 = ctr_in[2], c3 = ctr_in[3];
+    uint32_t k0 = key_in[0], k1 = key_in[1];
+    for (int i = 0; i < 10; ++i) {
+        const uint64_t p0 = (uint64_t)0xD2511F53u * c0;
+        const uint64_t p1 = (uint64_t)0xCD9E8D57u * c2;
+        c0 = (uint32_t)(p1 >> 32) ^ c1 ^ k0;
+        c1 = (uint32_t)p1;
+        c2 = (uint32_t)(p0 >> 32) ^ c3 ^ k1;
+        c3 = (uint32_t)p0;
+        k0 += 0x9E3779B9u;
+        k1 += 0xBB67AE85u;
+    }
+    out[0] = c0; out[1] = c1; out[2] = c2; out[3] = c3;
+}
+
+static unsigned long nineml_philox_get(void* vstate) {
+    nineml_philox_state* s = (nineml_philox_state*)vstate;
+    if (s->pos == 4) {
+        nineml_philox_block(s->ctr, s->key, s->buf);
+        if (!++s->ctr[0])
+            ++s->ctr[1];
+        s->pos = 0;
+    }
+    return s->buf[s->pos++];
+}
+
+static double nineml_philox_get_double(void* vstate) {
+    // 53-bit resolution in [0, 1)
+    const uint32_t a = nineml_philox_get(vstate) >> 5, b = nineml_philox_get(vstate) >> 6;
+    return (a * 67108864.0 + b) * (1.0 / 9007199254740992.0);
+}
+
+static void nineml_philox_set(void* vstate, unsigned long seed) {
+    nineml_philox_state* s = (nineml_philox_state*)vstate;
+    s->key[0] = (uint32_t)seed;
+    s->key[1] = 0;
+    s->ctr[0] = s->ctr[1] = s->ctr[2] = s->ctr[3] = 0;
+    s->pos = 4;
+}
+
+static const gsl_rng_type nineml_philox_type = {
+    "nineml_philox4x32", 0xFFFFFFFFUL, 0, sizeof(nineml_philox_state),
+    &nineml_philox_set, &nineml_philox_get, &nineml_philox_get_double};
+
+// Tags in the last word of the counter that separate the per-thread streams
+// from the per-instance streams
+static const uint32_t INSTANCE_STREAM = 0;
+static const uint32_t THREAD_STREAM = 1;
+
 
+/* SEEDING */
 
+// Incremented on each reseed so that the generators of each thread are
+// rekeyed on their next use
+static volatile unsigned int _seed = 0;
+static volatile unsigned int _seed_epoch = 0;
+static unsigned int _num_threads_used = 0;
 
+static NINEML_THREAD_LOCAL gsl_rng* _thread_rng = NULL;
+static NINEML_THREAD_LOCAL gsl_rng* _instance_rng = NULL;
+static NINEML_THREAD_LOCAL unsigned int _thread_epoch = 0;
+static NINEML_THREAD_LOCAL unsigned int _thread_index = 0;
+
+// Buffers of pre-generated variates of the stream of each thread, which are
+// discarded when reseeded
+#define NINEML_BUFFER_SIZE 256
+struct nineml_buffer {
+    double values[NINEML_BUFFER_SIZE];
+    unsigned int pos;
+    unsigned int epoch;
+};
+static NINEML_THREAD_LOCAL nineml_buffer* _normal_buffer = NULL;
+static NINEML_THREAD_LOCAL nineml_buffer* _uniform_buffer = NULL;
 
-gsl_rng* nineml_gsl_rng = NULL;
-unsigned int _seed = 0;
-  
 /* FUNCTIONS FOR ALLOCATING & DEALLOCATING RNG */
+
+// Returns the generator of the stream of the calling thread
 extern "C"
 gsl_rng* get_gsl_rng()
 {
-    if(nineml_gsl_rng == NULL)
+    if(_thread_rng == NULL)
+    {
+        _thread_rng = gsl_rng_alloc (&nineml_philox_type);
+        _thread_index = __sync_fetch_and_add(&_num_threads_used, 1);
+        _thread_epoch = _seed_epoch - 1;
+    }
+    if (_thread_epoch != _seed_epoch)
     {
-        nineml_gsl_rng = gsl_rng_alloc (gsl_rng_mt19937);
+        nineml_philox_state* s = (nineml_philox_state*)_thread_rng->state;
+        nineml_philox_set(s, _seed);
+        s->key[1] = _thread_index;
+        s->ctr[3] = THREAD_STREAM;
+        _thread_epoch = _seed_epoch;
     }
-    return nineml_gsl_rng;
+    return _thread_rng;
 }
 
+// Releases the generators of the calling thread
 extern "C"
 void release_gsl_rng()
 {
-    if(nineml_gsl_rng)
+    if(_thread_rng)
     {
-        gsl_rng_free (nineml_gsl_rng);
-        nineml_gsl_rng = NULL;
+        gsl_rng_free (_thread_rng);
+        _thread_rng = NULL;
     }
+    if(_instance_rng)
+    {
+        gsl_rng_free (_instance_rng);
+        _instance_rng = NULL;
+    }
+    delete _normal_buffer;
+    _normal_buffer = NULL;
+    delete _uniform_buffer;
+    _uniform_buffer = NULL;
 }
 
 extern "C"
 void nineml_seed_gsl_rng(unsigned int seed) {
 
-    gsl_rng* rng = get_gsl_rng();
-    gsl_rng_set(rng, seed);
     _seed = seed;
+    __sync_fetch_and_add(&_seed_epoch, 1);
 
 }
 
@@ -62,53 +195,265 @@ void nineml_seed_gsl_rng(unsigned int seed) {
 extern "C"
 unsigned int nineml_get_gsl_rng_seed() {
 
-    printf("%d\n", _seed);
     return _seed;
 
 }
 
 
+/* PER-INSTANCE STREAMS */
+
+// Sets the key and the high word of the counter of 'stream'
+static inline void nineml_instance_key(double stream, uint32_t key[2], uint32_t* stream_hi) {
+    const uint64_t id = (uint64_t)(int64_t)stream;
+    key[0] = _seed;
+    key[1] = (uint32_t)id;
+    *stream_hi = (uint32_t)(id >> 32);
+}
+
+// Positions the generator of the calling thread at 'counter' in 'stream'
+static inline gsl_rng* nineml_instance_rng(double stream, double counter) {
+    if (_instance_rng == NULL)
+        _instance_rng = gsl_rng_alloc (&nineml_philox_type);
+    nineml_philox_state* s = (nineml_philox_state*)_instance_rng->state;
+    const uint64_t block = (uint64_t)counter;
+    nineml_instance_key(stream, s->key, &s->ctr[2]);
+    s->ctr[0] = (uint32_t)block;
+    s->ctr[1] = (uint32_t)(block >> 32);
+    s->ctr[3] = INSTANCE_STREAM;
+    s->pos = 4;
+    return _instance_rng;
+}
+
+// Stores the position of the generator after the draw back into the counter
+// (partially used blocks are discarded)
+static inline void nineml_store_counter(gsl_rng* r, double* counter) {
+    const nineml_philox_state* s = (const nineml_philox_state*)r->state;
+    *counter = (double)(((uint64_t)s->ctr[1] << 32) | s->ctr[0]);
+}
+
+
+/* BATCHED VARIATES */
+
+enum nineml_transform { NINEML_UNIFORM, NINEML_NORMAL };
+
+// Blocks generated per pass of nineml_fill
+static const size_t NINEML_CHUNK_BLOCKS = 64;
+
+// Converts two words into a double in [0, 1) with 53-bit resolution
+static inline double nineml_to_double(uint32_t hi, uint32_t lo) {
+    return ((hi >> 5) * 67108864.0 + (lo >> 6)) * (1.0 / 9007199254740992.0);
+}
+
+// Draws n standard uniform or normal variates from the consecutive blocks of
+// the stream starting at *block (two per block), advancing it past the blocks
+// used
+static void nineml_fill(const uint32_t key[2], uint32_t stream_hi, uint32_t tag,
+                        uint64_t* block, double* out, size_t n,
+                        nineml_transform transform) {
+    uint32_t w[4 * NINEML_CHUNK_BLOCKS];
+    while (n) {
+        const size_t n_blocks = (n + 1) / 2 < NINEML_CHUNK_BLOCKS ? (n + 1) / 2 : NINEML_CHUNK_BLOCKS;
+        // The blocks are independent of each other so can be generated in
+        // parallel
+        for (size_t i = 0; i < n_blocks; ++i) {
+            const uint64_t b = *block + i;
+            const uint32_t ctr[4] = {(uint32_t)b, (uint32_t)(b >> 32), stream_hi, tag};
+            nineml_philox_block(ctr, key, w + 4 * i);
+        }
+        *block += n_blocks;
+        const size_t m = n < 2 * n_blocks ? n : 2 * n_blocks;
+        for (size_t i = 0; i < n_blocks; ++i) {
+            double v0 = nineml_to_double(w[4 * i], w[4 * i + 1]);
+            double v1 = nineml_to_double(w[4 * i + 2], w[4 * i + 3]);
+            if (transform == NINEML_NORMAL) {
+                const double r = sqrt(-2.0 * log(1.0 - v0));  // 1 - v0 in (0, 1]
+                const double a = 2.0 * M_PI * v1;
+                v0 = r * cos(a);
+                v1 = r * sin(a);
+            }
+            out[2 * i] = v0;
+            if (2 * i + 1 < m)
+                out[2 * i + 1] = v1;
+        }
+        out += m;
+        n -= m;
+    }
+}
+
+// Draws n variates from the stream of the calling thread
+static void nineml_thread_fill(double* out, size_t n, nineml_transform transform) {
+    nineml_philox_state* s = (nineml_philox_state*)get_gsl_rng()->state;
+    uint64_t block = ((uint64_t)s->ctr[1] << 32) | s->ctr[0];
+    nineml_fill(s->key, s->ctr[2], s->ctr[3], &block, out, n, transform);
+    s->ctr[0] = (uint32_t)block;
+    s->ctr[1] = (uint32_t)(block >> 32);
+}
+
+// Draws n variates from the stream of a mechanism instance
+static void nineml_instance_fill(double stream, double* counter, double* out, size_t n,
+                                 nineml_transform transform) {
+    uint32_t key[2], stream_hi;
+    nineml_instance_key(stream, key, &stream_hi);
+    uint64_t block = (uint64_t)*counter;
+    nineml_fill(key, stream_hi, INSTANCE_STREAM, &block, out, n, transform);
+    *counter = (double)block;
+}
+
+// Pops the next variate from a buffer of the calling thread, refilling it
+// if it is empty or the generators have been reseeded
+static inline double nineml_pop(nineml_buffer*& buffer, nineml_transform transform) {
+    get_gsl_rng();  // Rekeys the stream of the thread if reseeded
+    if (buffer == NULL) {
+        buffer = new nineml_buffer;
+        buffer->pos = NINEML_BUFFER_SIZE;
+    }
+    if (buffer->pos == NINEML_BUFFER_SIZE || buffer->epoch != _thread_epoch) {
+        nineml_thread_fill(buffer->values, NINEML_BUFFER_SIZE, transform);
+        buffer->pos = 0;
+        buffer->epoch = _thread_epoch;
+    }
+    return buffer->values[buffer->pos++];
+}
+
+extern "C"
+void nineml_gsl_fill_normal(double* out, size_t n, double m, double s)
+{
+    nineml_thread_fill(out, n, NINEML_NORMAL);
+    for (size_t i = 0; i < n; ++i)
+        out[i] = m + s * out[i];
+}
+
+
+extern "C"
+void nineml_gsl_fill_uniform(double* out, size_t n, double a, double b)
+{
+    nineml_thread_fill(out, n, NINEML_UNIFORM);
+    for (size_t i = 0; i < n; ++i)
+        out[i] = a + (b - a) * out[i];
+}
+
+
+extern "C"
+void nineml_gsl_fill_exponential(double* out, size_t n, double lambda)
+{
+    nineml_thread_fill(out, n, NINEML_UNIFORM);
+    for (size_t i = 0; i < n; ++i)
+        out[i] = -log(1.0 - out[i]) / lambda;
+}
+
+
+extern "C"
+void nineml_rng_fill_normal(double stream, double* counter, double* out, size_t n, double m, double s)
+{
+    nineml_instance_fill(stream, counter, out, n, NINEML_NORMAL);
+    for (size_t i = 0; i < n; ++i)
+        out[i] = m + s * out[i];
+}
+
+
+extern "C"
+void nineml_rng_fill_uniform(double stream, double* counter, double* out, size_t n, double a, double b)
+{
+    nineml_instance_fill(stream, counter, out, n, NINEML_UNIFORM);
+    for (size_t i = 0; i < n; ++i)
+        out[i] = a + (b - a) * out[i];
+}
+
+
+extern "C"
+void nineml_rng_fill_exponential(double stream, double* counter, double* out, size_t n, double lambda)
+{
+    nineml_instance_fill(stream, counter, out, n, NINEML_UNIFORM);
+    for (size_t i = 0; i < n; ++i)
+        out[i] = -log(1.0 - out[i]) / lambda;
+}
+
+
 // Wrapper Functions:
 //
 
 extern "C"
 double nineml_gsl_normal(double m, double s)
 {
-    gsl_rng* r = get_gsl_rng();
-    return m + gsl_ran_gaussian(r, s);
+    return m + s * nineml_pop(_normal_buffer, NINEML_NORMAL);
 }
 
 
 extern "C"
 double nineml_gsl_uniform(double a, double b)
 {
-    gsl_rng* r = get_gsl_rng();
-    return gsl_ran_flat(r, a, b);
+    return a + (b - a) * nineml_pop(_uniform_buffer, NINEML_UNIFORM);
 }
 
-       
+
 extern "C"
 double nineml_gsl_binomial(double p, int n)
 {
     gsl_rng* r = get_gsl_rng();
     return gsl_ran_binomial(r, p, n);
 }
-       
-       
+
+
 extern "C"
 double nineml_gsl_exponential(double lambda)
 {
-    gsl_rng* r = get_gsl_rng();
-    return gsl_ran_exponential(r,1.0/lambda);
+    return -log(1.0 - nineml_pop(_uniform_buffer, NINEML_UNIFORM)) / lambda;
 }
-       
-       
+
+
 extern "C"
 double nineml_gsl_poisson(double mu)
 {
     gsl_rng* r = get_gsl_rng();
     return gsl_ran_poisson(r,mu);
 }
-       
-       
-       
+
+
+// Per-instance wrapper Functions:
+//
+
+extern "C"
+double nineml_rng_normal(double stream, double* counter, double m, double s)
+{
+    double x;
+    nineml_rng_fill_normal(stream, counter, &x, 1, m, s);
+    return x;
+}
+
+
+extern "C"
+double nineml_rng_uniform(double stream, double* counter, double a, double b)
+{
+    double x;
+    nineml_rng_fill_uniform(stream, counter, &x, 1, a, b);
+    return x;
+}
+
+
+extern "C"
+double nineml_rng_binomial(double stream, double* counter, double p, int n)
+{
+    gsl_rng* r = nineml_instance_rng(stream, *counter);
+    const double x = gsl_ran_binomial(r, p, n);
+    nineml_store_counter(r, counter);
+    return x;
+}
+
+
+extern "C"
+double nineml_rng_exponential(double stream, double* counter, double lambda)
+{
+    double x;
+    nineml_rng_fill_exponential(stream, counter, &x, 1, lambda);
+    return x;
+}
+
+
+extern "C"
+double nineml_rng_poisson(double stream, double* counter, double mu)
+{
+    gsl_rng* r = nineml_instance_rng(stream, *counter);
+    const double x = gsl_ran_poisson(r, mu);
+    nineml_store_counter(r, counter);
+    return x;
+}
@@ -8,11 +8,14 @@
            the MIT Licence, see LICENSE for details.
 """
 from __future__ import absolute_import
+import nineml.units as un
 import pyNN.neuron
 from pyNN.common.control import build_state_queries
 import pyNN.neuron.simulator as simulator
+from neuron import h
 from pyNN.neuron.standardmodels.synapses import StaticSynapse
 import logging
+import numpy as np
 from pype9.simulate.common.network.base import (
     Network as BaseNetwork, ComponentArray as BaseComponentArray,
     ConnectionGroup as BaseConnectionGroup, Selection as BaseSelection)
@@ -32,6 +35,13 @@ class ComponentArray(BaseComponentArray, pyNN.neuron.Population):
 
     PyNNCellWrapperMetaClass = PyNNCellWrapperMetaClass
     PyNNPopulationClass = pyNN.neuron.Population
+    # The cells are placed on the given ranks by a copy of
+    # pyNN.neuron.Population._create_cells, which matches the internals of
+    # this release series of PyNN only (round-robin placement is used with
+    # other versions)
+    PLACEMENT_PYNN_VERSION = '0.9'
+    SUPPORTS_PLACEMENT = pyNN.__version__.startswith(
+        PLACEMENT_PYNN_VERSION + '.')
     PyNNProjectionClass = pyNN.neuron.Projection
     SynapseClass = StaticSynapse
     SpikeSourceArray = pyNN.neuron.SpikeSourceArray
@@ -47,11 +57,102 @@ class ComponentArray(BaseComponentArray, pyNN.neuron.Population):
     def _min_delay(self):
         return get_min_delay()
 
-    def record(self, port_name):
+    def _create_cells(self):
+        if self._ranks is None:
+            return pyNN.neuron.Population._create_cells(self)
+        # Copied from pyNN.neuron.Population._create_cells (see
+        # PLACEMENT_PYNN_VERSION) with the round-robin mask replaced, so the
+        # cells are placed on the given ranks (the gids are registered with
+        # the ParallelContext on whichever process builds the cell)
+        self.first_id = simulator.state.gid_counter
+        self.last_id = simulator.state.gid_counter + self.size - 1
+        self.all_cells = np.array(
+            [id_ for id_ in range(self.first_id, self.last_id + 1)],
+            simulator.ID)
+        self._mask_local = np.asarray(self._ranks) == simulator.state.mpi_rank
+        parameter_space = self.celltype.parameter_space
+        parameter_space.shape = (self.size,)
+        parameter_space.evaluate(mask=self._mask_local, simplify=False)
+        for i, (id_, is_local, params) in enumerate(
+                zip(self.all_cells, self._mask_local, parameter_space)):
+            self.all_cells[i] = simulator.ID(id_)
+            self.all_cells[i].parent = self
+            if is_local:
+                if hasattr(self.celltype, "extra_parameters"):
+                    params.update(self.celltype.extra_parameters)
+                self.all_cells[i]._build_cell(self.celltype.model, params)
+        simulator.initializer.register(self)
+        simulator.state.gid_counter += self.size
+
+    def _get_columns(self, names):
+        # Access the RANGE variables of the mechanisms directly, bypassing
+        # the unit handling of the Cell attributes
+        cells = [c._cell for c in self.local_cells]
+        return [np.fromiter((c._get(n) for c in cells), dtype=float,
+                            count=len(cells)) for n in names]
+
+    def _set_columns(self, columns):
+        cells = [c._cell for c in self.local_cells]
+        for name, values in columns.items():
+            if cells and name == cells[0].cm_param_name:
+                # Also needs to set the capacitance of the section
+                for cell, value in zip(cells, values):
+                    cell._set(name, value)
+                continue
+            for cell, value in zip(cells, values):
+                try:
+                    setattr(cell._hoc, name, value)
+                except LookupError:
+                    # Section variables (e.g. membrane voltage)
+                    cell._set(name, value)
+
+    def _get_regimes(self):
+        # NB: On-condition triggers are re-armed by the WATCH statements when
+        # the mechanisms are initialised so there are no trigger flags to save
+        regime_varname = self.celltype.model.code_generator.REGIME_VARNAME
+        return np.fromiter(
+            (getattr(c._cell._hoc, regime_varname) for c in self.local_cells),
+            dtype=int, count=len(self.local_cells))
+
+    def _set_regimes(self, indices):
+        for c, index in zip(self.local_cells, indices):
+            c._cell.set_regime(
+                self.celltype.model.from_regime_index(int(index)))
+
+    def _play_analog(self, port_name, signal):
+        # Each local cell plays the signal into its own IClamp (the port needs
+        # to be one of the external currents the array was built with)
+        cells = [c._cell for c in self.local_cells]
+        for cell in cells:
+            cell.play(port_name, signal)
+        return cells
+
+    @property
+    def _stream_delay(self):
+        # The spikes are queued directly on the NetCons at their arrival times
+        return 0.0
+
+    def _create_stream_sources(self, port_name, weight):  # @UnusedVariable
+        netcons = []
+        for c in self.local_cells:
+            netcon = h.NetCon(None, c._cell._hoc)
+            netcon.weight[0] = weight
+            netcons.append(netcon)
+        return (np.nonzero(self._mask_local)[0], netcons)
+
+    def _feed_stream_sources(self, sources, indices, times):
+        local_indices, netcons = sources
+        for pos, t in zip(np.searchsorted(local_indices, indices), times):
+            netcons[pos].event(float(t))
+
+    def record(self, port_name, interval=None):
         communicates, to_record = self._get_port_details(port_name)
         if communicates == 'event':
             to_record = 'spikes'  # FIXME: Need a way of differentiating event send ports @IgnorePep8
-        pyNN.neuron.Population.record(self, to_record)
+        if interval is not None:
+            interval = float(interval.in_units(un.ms))
+        pyNN.neuron.Population.record(self, to_record,
+                                    sampling_interval=interval)
 
 
 class Selection(BaseSelection, pyNN.neuron.Assembly):
@@ -4,6 +4,7 @@ import ctypes
 from pyNN.neuron import (
     setup as pyNN_setup, run as pyNN_run, end as pyNN_end, state as pyNN_state)
 from pyNN.neuron.simulator import initializer as pyNN_initializer
+from neuron import h
 from pype9.simulate.common.simulation import Simulation as BaseSimulation
 from pype9.simulate.neuron.code_gen import CodeGenerator
 from pype9.exceptions import Pype9UsageError
@@ -27,8 +28,12 @@ class Simulation(BaseSimulation):
     DEFAULT_MAX_DELAY = 10 * un.ms
 
     def __init__(self, *args, **kwargs):
+        # Whether to execute the simulation with CoreNEURON, which requires
+        # all mechanisms to be built with the 'coreneuron' option
+        self._coreneuron = kwargs.pop('coreneuron', False)
         super(Simulation, self).__init__(*args, **kwargs)
         self._has_random_processes = False
+        self._num_independent_cells = 0
 
     def _run(self, t_stop, callbacks=None, **kwargs):  # @UnusedVariable
         """
@@ -71,6 +76,19 @@ class Simulation(BaseSimulation):
                    min_delay=float(min_delay.in_units(un.ms)),
                    max_delay=float(max_delay.in_units(un.ms)),
                    **kwargs)
+        if self.threads_per_process > 1:
+            # NB: All mechanisms need to be THREADSAFE (the generated ones are
+            # declared so in both the standard and CoreNEURON output modes).
+            # The random processes of the cells are drawn from per-instance
+            # streams of libninemlnrn (see register_array) so don't depend on
+            # the threads the cells are simulated on
+            pyNN_state.parallel_context.nthread(self.threads_per_process)
+        if self._coreneuron:
+            from neuron import coreneuron
+            # CoreNEURON requires the data of the mechanisms to be laid out
+            # contiguously
+            h.cvode.cache_efficient(1)
+            coreneuron.enable = True
 
     def _initialize(self):
         """
@@ -81,6 +99,20 @@ class Simulation(BaseSimulation):
             self._seed_libninemlnrn()
         super(Simulation, self)._initialize()
 
+    def _restore_checkpoint(self):
+        # The states of the mechanisms are reset by h.finitialize at the start
+        # of the first run, so the simulator is initialised with a run of
+        # zero length before the checkpoint is restored
+        self._run(0.0 * un.ms)
+        super(Simulation, self)._restore_checkpoint()
+
+    def _feed_input_streams(self, t_start, t_stop):
+        # Events queued with NetCon.event are cleared by h.finitialize, so the
+        # simulator is initialised before the first segment is fed
+        if not pyNN_state.running:
+            self._run(0.0 * un.ms)
+        super(Simulation, self)._feed_input_streams(t_start, t_stop)
+
     def mpi_rank(self):
         "The rank of the MPI node the code is running on"
         return pyNN_state.mpi_rank
@@ -89,10 +121,6 @@ class Simulation(BaseSimulation):
         "The number of MPI processes"
         return pyNN_state.num_processes
 
-    def num_threads(self):
-        "The total number of threads across all MPI nodes"
-        return self.num_processes()
-
     def register_cell(self, cell):
         super(Simulation, self).register_cell(cell)
         # The initial states of NMODL mechanism need to be set twice before and
@@ -105,6 +133,10 @@ class Simulation(BaseSimulation):
         pyNN_initializer.register(self._DummyID(cell))
         if cell.component_class.is_random:
             self._has_random_processes = True
+            # Independent cells are given negative stream ids so they don't
+            # clash with the gids of cells in arrays
+            self._num_independent_cells += 1
+            cell._set_rng_stream(-self._num_independent_cells)
 
     def register_array(self, array):
         super(Simulation, self).register_array(array)
@@ -119,11 +151,17 @@ class Simulation(BaseSimulation):
         # a PyNN population and independent.
         for id_ in array:
             self._registered_cells.append(id_._cell)
+            # Draw the random processes of each cell from the stream of its
+            # gid so they don't depend on the distribution of the cells over
+            # the processes
+            if array.component_class.is_random:
+                id_._cell._set_rng_stream(int(id_))
 
     def _seed_libninemlnrn(self):
         """
         Sets the random seed used by libninemlnrn to generate random
-        distributions.
+        distributions. The global seed is used as the streams of each cell are
+        separated by their ids in the counter-based generator.
         """
         # Could be performed in __enter__ along with the setting of other seeds
         # but there is a problem loading the library with ctypes before it has
@@ -131,7 +169,9 @@ class Simulation(BaseSimulation):
         # initialisation
         libninemlnrn = ctypes.CDLL(self.code_generator.libninemlnrn_so)
         libninemlnrn.nineml_seed_gsl_rng.arg_types = [ctypes.c_int()]
-        libninemlnrn.nineml_seed_gsl_rng(int(self.dynamics_seed))
+        libninemlnrn.nineml_seed_gsl_rng(int(self.global_seed))
+        # Seed the Random123 streams of CoreNEURON-compatible mechanisms
+        h.Random123_globalindex(int(self.global_seed))
 
     @classmethod
     def quit(cls):
@@ -1,3 +1,6 @@
+import numpy
+
+
 class DummyMPICom(object):
 
     rank = 0
@@ -6,6 +9,9 @@ class DummyMPICom(object):
     def barrier(self):
         pass
 
+    def allgather(self, obj):
+        return [obj]
+
 try:
     from mpi4py import MPI  # @UnusedImport @IgnorePep8 This is imported before NEURON to avoid a bug in NEURON
 except ImportError:
@@ -18,3 +24,78 @@ MPI_ROOT = 0
 
 def is_mpi_master():
     return (mpi_comm.rank == MPI_ROOT)
+
+
+def affinity_order(names, affinities):
+    """
+    Orders groups of cells so that strongly connected groups are adjacent,
+    by greedily chaining each group to the remaining group it is most
+    strongly connected to (starting from the most strongly connected group)
+
+    Parameters
+    ----------
+    names : list(str)
+        The names of the groups
+    affinities : dict((str, str), float)
+        The strength of the connections (e.g. the expected number of
+        connections) between pairs of groups, in either direction
+
+    Returns
+    -------
+    order : list(str)
+        The names of the groups in the order they should be placed
+    """
+    def affinity(a, b):
+        return affinities.get((a, b), 0.0) + affinities.get((b, a), 0.0)
+    remaining = list(names)
+    order = []
+    while remaining:
+        if order:
+            nxt = max(remaining, key=lambda n: affinity(order[-1], n))
+            if not affinity(order[-1], nxt):
+                nxt = None
+        else:
+            nxt = None
+        if nxt is None:
+            # Start a new chain from the most strongly connected group left
+            nxt = max(remaining, key=lambda n: sum(
+                affinity(n, m) for m in remaining if m != n))
+        remaining.remove(nxt)
+        order.append(nxt)
+    return order
+
+
+def balanced_placement(sizes, costs, num_processes):
+    """
+    Assigns the cells of groups (in the order given) to contiguous blocks of
+    processes so that the estimated cost of each process per time step is
+    balanced to within the cost of a single cell, while each group is split
+    over as few processes as possible
+
+    Parameters
+    ----------
+    sizes : list(int)
+        The number of cells in each group
+    costs : list(float)
+        The estimated cost per time step of a cell of each group
+    num_processes : int
+        The number of processes to place the cells on
+
+    Returns
+    -------
+    ranks : list(numpy.ndarray(int))
+        The rank of the process each cell of each group is placed on
+    """
+    if not sizes:
+        return []
+    cell_costs = numpy.concatenate([numpy.ones(s) * c
+                                    for s, c in zip(sizes, costs)])
+    total = numpy.sum(cell_costs)
+    if not total:
+        cell_costs = numpy.ones(len(cell_costs))
+        total = float(len(cell_costs))
+    # Place each cell on the process the midpoint of its cost falls into
+    midpoints = numpy.cumsum(cell_costs) - cell_costs / 2.0
+    ranks = numpy.minimum((midpoints * num_processes / total).astype(int),
+                          num_processes - 1)
+    return numpy.split(ranks, numpy.cumsum(sizes)[:-1])
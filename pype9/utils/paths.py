@@ -1,6 +1,7 @@
 import os
 import sys
 import errno
+import socket
 import shutil
 
 
@@ -31,3 +32,100 @@ def add_lib_path(path):
         os.environ[lib_path_key] += os.pathsep + path
     else:
         os.environ[lib_path_key] = path
+
+
+def copytree_atomic(src, dest, ignore=None, marker=None):
+    """
+    Copies a directory tree to a temporary sibling of the destination and then
+    renames it into place, so that other processes (potentially on other
+    hosts sharing the file system) never see a partially copied tree.
+
+    An existing destination is only replaced if a marker file is provided,
+    which flags the tree as complete. In that case the destination is updated
+    in place (so it never goes missing): the marker is removed first, then
+    each file is renamed over its counterpart, stale files are removed and
+    finally the marker of the copy is renamed into place. Processes that
+    check for the marker therefore either see the old or the new tree.
+
+    Parameters
+    ----------
+    src : str
+        Path of the directory tree to copy
+    dest : str
+        Path of the destination directory
+    ignore : callable | None
+        Passed to shutil.copytree to select the files to skip
+    marker : str | None
+        Path of the marker file relative to the root of the tree. If None an
+        existing destination is left as is.
+
+    Returns
+    -------
+    replaced : bool
+        False if the destination already existed (or another process renamed
+        a tree into it first) and wasn't replaced, in which case it is kept
+    """
+    suffix = '.{}-{}'.format(socket.gethostname(), os.getpid())
+    tmp_dir = dest + '.tmp' + suffix
+    parent = os.path.dirname(dest)
+    try:
+        os.makedirs(parent)
+    except OSError as e:
+        if e.errno != errno.EEXIST:
+            raise
+    remove_ignore_missing(tmp_dir)
+    shutil.copytree(src, tmp_dir, ignore=ignore)
+    try:
+        # Renames are atomic and fail if the destination is a non-empty
+        # directory
+        os.rename(tmp_dir, dest)
+        return True
+    except OSError as e:
+        if e.errno not in (errno.EEXIST, errno.ENOTEMPTY):
+            raise
+    try:
+        if marker is None:
+            return False
+        _replace_tree_contents(tmp_dir, dest, marker)
+    finally:
+        remove_ignore_missing(tmp_dir)
+    return True
+
+
+def _replace_tree_contents(src, dest, marker):
+    """
+    Moves the files of the 'src' tree over those of the 'dest' tree one by one
+    and removes the files of 'dest' that aren't in 'src', with the marker file
+    removed first and moved into place last (see copytree_atomic)
+    """
+    remove_ignore_missing(os.path.join(dest, marker))
+    copied = set([marker])
+    copied_dirs = set()
+    for dpath, _, fnames in os.walk(src):
+        rel_dir = os.path.relpath(dpath, src)
+        copied_dirs.add(os.path.normpath(rel_dir))
+        dest_dir = os.path.normpath(os.path.join(dest, rel_dir))
+        if not os.path.isdir(dest_dir):
+            remove_ignore_missing(dest_dir)
+            os.makedirs(dest_dir)
+        for fname in fnames:
+            rel_path = os.path.normpath(os.path.join(rel_dir, fname))
+            copied.add(rel_path)
+            if rel_path != marker:
+                dest_path = os.path.join(dest, rel_path)
+                if os.path.isdir(dest_path):
+                    remove_ignore_missing(dest_path)
+                os.rename(os.path.join(dpath, fname), dest_path)
+    for dpath, dnames, fnames in os.walk(dest, topdown=False):
+        rel_dir = os.path.relpath(dpath, dest)
+        for fname in fnames:
+            if os.path.normpath(os.path.join(rel_dir, fname)) not in copied:
+                os.remove(os.path.join(dpath, fname))
+        for dname in dnames:
+            rel_path = os.path.normpath(os.path.join(rel_dir, dname))
+            if not any(d == rel_path or d.startswith(rel_path + os.sep)
+                       for d in copied_dirs):
+                remove_ignore_missing(os.path.join(dpath, dname))
+    src_marker = os.path.join(src, marker)
+    if os.path.exists(src_marker):
+        os.rename(src_marker, os.path.join(dest, marker))
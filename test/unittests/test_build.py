@@ -1,11 +1,18 @@
 from __future__ import division
 from __future__ import print_function
+import os
+import json
+import shutil
+import tempfile
+import subprocess
+from collections import OrderedDict
 import ninemlcatalog
 from nineml.abstraction import Parameter, TimeDerivative, StateVariable
 import nineml.units as un
 from pype9.simulate.nest import CellMetaClass
+from pype9.simulate.nest.code_gen import CodeGenerator
 from pype9.simulate.common.cells.with_synapses import WithSynapses
-from pype9.exceptions import Pype9BuildMismatchError
+from pype9.exceptions import Pype9BuildMismatchError, Pype9BuildError
 from unittest import TestCase  # @Reimport
 import pype9.utils.logging.handlers.sysout  # @UnusedImport
 
@@ -28,3 +35,107 @@ class TestSeeding(TestCase):
             Pype9BuildMismatchError,
             CellMetaClass,
             izhi2_wrap)
+
+    def test_bench(self):
+        iaf = ninemlcatalog.load('neuron/LeakyIntegrateAndFire',
+                                 'PyNNLeakyIntegrateAndFire')
+        celltype = CellMetaClass(WithSynapses.wrap(iaf), bench=True,
+                                 build_version='Bench')
+        bench_path = celltype.code_generator.get_bench_path(
+            celltype.name, celltype.build_component_class.url)
+        output = subprocess.check_output(
+            [bench_path, '--num_neurons=10', '--num_steps=1000'])
+        results = json.loads(output.decode('utf-8'))
+        self.assertEqual(results['num_neurons'], 10)
+        self.assertEqual(results['num_steps'], 1000)
+        self.assertGreater(results['ns_per_neuron_step'], 0.0)
+        self.assertEqual(set(results['regimes']),
+                         set(r.name for r in iaf.regimes))
+        # Every update of every instance is timed in one of the regimes
+        self.assertEqual(
+            sum(r['neuron_steps'] for r in results['regimes'].values()),
+            10 * 1000)
+
+
+class TestBuildCache(TestCase):
+
+    def test_build_cache(self):
+        cache_dir = tempfile.mkdtemp()
+        base_dirs = [tempfile.mkdtemp(), tempfile.mkdtemp()]
+        try:
+            gen1, gen2 = (CodeGenerator(base_dir=d, cache_dir=cache_dir)
+                          for d in base_dirs)
+            iaf = WithSynapses.wrap(ninemlcatalog.load(
+                'neuron/LeakyIntegrateAndFire', 'PyNNLeakyIntegrateAndFire'))
+            # The order of the items in mapping-valued build options shouldn't
+            # affect the build key
+            consts = [('tau_m', 20.0), ('tau_refrac', 2.0)]
+            kwargs1 = {'constant_parameters': OrderedDict(consts)}
+            kwargs2 = {'constant_parameters': OrderedDict(consts[::-1])}
+            build_iaf = gen1.transform_for_build('IaFCached', iaf, **kwargs1)
+            # Build locally and publish the build to the cache
+            gen1.generate(build_iaf, **kwargs1)
+            self.assertEqual(len(os.listdir(gen1.cache_dir)), 1)
+            # Another build directory sharing the cache restores the build
+            # (without its intermediate compile files) instead of compiling
+            install_dir = gen2.generate(build_iaf, **kwargs2)
+            name, url = build_iaf.name, build_iaf.url
+            self.assertTrue(os.listdir(install_dir))
+            self.assertFalse(os.path.exists(gen2.get_compile_dir(name, url)))
+            self.assertEqual(gen2.built_key(name, url),
+                             gen1.built_key(name, url))
+            # Different build options result in a separate cache entry
+            kwargs2['ode_solver'] = 'exact'
+            gen2.generate(gen2.transform_for_build('IaFCached', iaf,
+                                                   **kwargs2),
+                          build_mode='force', **kwargs2)
+            self.assertTrue(os.path.exists(gen2.get_compile_dir(name, url)))
+            self.assertEqual(len(os.listdir(gen1.cache_dir)), 2)
+        finally:
+            for d in [cache_dir] + base_dirs:
+                shutil.rmtree(d)
+
+    def test_pgo_profile(self):
+        base_dir = tempfile.mkdtemp()
+        try:
+            code_gen = CodeGenerator(base_dir=base_dir)
+            iaf = WithSynapses.wrap(ninemlcatalog.load(
+                'neuron/LeakyIntegrateAndFire', 'PyNNLeakyIntegrateAndFire'))
+            build_iaf = code_gen.transform_for_build('IaFPGO', iaf,
+                                                     build_profile='pgo')
+            name, url = build_iaf.name, build_iaf.url
+            compile_dir = code_gen.get_compile_dir(name, url)
+            marker = os.path.join(compile_dir, CodeGenerator._PGO_DIR,
+                                  CodeGenerator._PGO_TRAINED)
+            digest_path = os.path.join(compile_dir,
+                                       CodeGenerator._PGO_SOURCES)
+            cmake_lists = os.path.join(code_gen.get_source_dir(name, url),
+                                       'CMakeLists.txt')
+            code_gen.generate(build_iaf, build_profile='pgo')
+            self.assertTrue(os.path.exists(marker))
+            mtimes = (os.path.getmtime(marker),
+                      os.path.getmtime(cmake_lists))
+            with open(digest_path) as f:
+                digest = f.read()
+            # Regenerating the same sources keeps the recorded profile and
+            # leaves the build files untouched
+            code_gen.generate(build_iaf, build_mode='force',
+                              build_profile='pgo')
+            self.assertEqual((os.path.getmtime(marker),
+                              os.path.getmtime(cmake_lists)), mtimes)
+            # Changed sources are profiled again
+            kwargs = {'build_profile': 'pgo',
+                      'constant_parameters': {'tau_m': 20.0}}
+            code_gen.generate(
+                code_gen.transform_for_build('IaFPGO', iaf, **kwargs),
+                build_mode='force', **kwargs)
+            self.assertTrue(os.path.exists(marker))
+            with open(digest_path) as f:
+                self.assertNotEqual(f.read(), digest)
+            self.assertRaises(
+                Pype9BuildError, code_gen.generate,
+                code_gen.transform_for_build('IaFFastest', iaf,
+                                             build_profile='fastest'),
+                build_profile='fastest')
+        finally:
+            shutil.rmtree(base_dir)
@@ -0,0 +1,34 @@
+import os.path
+import tempfile
+import shutil
+import json
+from pype9.cmd import benchmark
+if __name__ == '__main__':
+    from pype9.utils.testing import DummyTestCase as TestCase  # @UnusedImport
+else:
+    from unittest import TestCase  # @Reimport
+
+
+class TestBenchmark(TestCase):
+
+    def setUp(self):
+        self.tmpdir = tempfile.mkdtemp()
+
+    def tearDown(self):
+        shutil.rmtree(self.tmpdir)
+
+    def test_benchmark(self):
+        out_path = os.path.join(self.tmpdir, 'benchmark.json')
+        argv = ("nest --benchmarks cells hh --hh_sizes 10 --num_threads 1 2 "
+                "--simtime 10.0 --build_mode lazy --save {}".format(out_path))
+        benchmark.run(argv.split())
+        with open(out_path) as f:
+            results = json.load(f)
+        # Two cell models and one population size, each with 1 and 2 threads
+        self.assertEqual(len(results['results']), 6)
+        for result in results['results']:
+            self.assertNotIn('error', result)
+            self.assertEqual(result['simulator'], 'nest')
+            self.assertGreater(result['wall_time_per_second'], 0.0)
+            self.assertEqual(len(result['memory_per_rank']),
+                             result['num_processes'])
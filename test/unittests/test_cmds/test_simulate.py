@@ -122,6 +122,97 @@ class TestSimulateCell(TestCase):
             self.assertEqual(regimes.labels[0], 'subVb')
             self.assertTrue('subthreshold' in regimes.labels)
 
+    def test_sweep(self):
+        sweep_path = '{}/sweep.csv'.format(self.tmpdir)
+        out_path = '{}/isyn.pkl'.format(self.tmpdir)
+        amps = [50.0, 100.0, 150.0]
+        with open(sweep_path, 'w') as f:
+            f.write('amplitude:{},onset:{}\n'.format(self.isyn_amp[1],
+                                                      self.isyn_onset[1]))
+            for amp in amps:
+                f.write('{},{}\n'.format(amp, self.isyn_onset[0]))
+        for simulator in ('neuron', 'nest'):
+            argv = ("{input_model} {sim} {t_stop} {dt} "
+                    "--record current_output {out_path} "
+                    "--sweep {sweep_path} "
+                    "--init_value current_output {init} "
+                    "--build_mode lazy "
+                    "--build_version CmdSweep "
+                    .format(input_model=self.isyn_path, sim=simulator,
+                            out_path=out_path, sweep_path=sweep_path,
+                            t_stop=self.t_stop, dt=self.dt,
+                            init='{} {}'.format(*self.isyn_init)))
+            simulate.run(argv.split())
+            isyn = neo.io.PickleIO(out_path).read()[0].analogsignals[0]
+            isyn = isyn.rescale(self.isyn_amp[1])
+            # The recordings of each copy of the cell are indexed by row
+            self.assertEqual(isyn.shape[1], len(amps))
+            for i, amp in enumerate(amps):
+                self.assertAlmostEqual(float(isyn[:, i].max()), amp,
+                                       places=6)
+                self.assertAlmostEqual(float(isyn[:, i].min()),
+                                       self.isyn_init[0], places=6)
+
+    def test_ode_sweep(self):
+        in_path = '{}/isyn.pkl'.format(self.tmpdir)
+        out_path = '{}/v.pkl'.format(self.tmpdir)
+        sweep_path = '{}/sweep.csv'.format(self.tmpdir)
+        # The first row uses the initial value of the reference simulation
+        init_vs = [self.V[0], -60.0, -70.0]
+        with open(sweep_path, 'w') as f:
+            f.write('V:{}\n'.format(self.V[1]))
+            for v in init_vs:
+                f.write('{}\n'.format(v))
+        argv = ("{input_model} nest {t_stop} {dt} "
+                "--record current_output {out_path} {rec_t_start} "
+                "--prop amplitude {amp} "
+                "--prop onset {onset} "
+                "--init_value current_output {init} "
+                "--build_mode lazy "
+                "--build_version Cmd "
+                .format(input_model=self.isyn_path, out_path=in_path,
+                        t_stop=self.t_stop, dt=self.dt,
+                        amp='{} {}'.format(*self.isyn_amp),
+                        onset='{} {}'.format(*self.isyn_onset),
+                        init='{} {}'.format(*self.isyn_init),
+                        rec_t_start='{} {}'.format(*self.rec_t_start)))
+        simulate.run(argv.split())
+        # The step current is played into every copy of the cell
+        isyn = neo.io.PickleIO(in_path).read()[0].analogsignals[0]
+        for simulator, options in (('nest', ''), ('nest', '--batched '),
+                                   ('neuron', '')):
+            argv = (
+                "{nineml_model} {sim} {t_stop} {dt} "
+                "--record V {out_path} {rec_t_start} "
+                "--sweep {sweep_path} "
+                "--init_value U {U} "
+                "--init_regime subVb "
+                "--play iSyn {in_path} "
+                "--build_mode lazy "
+                "--build_version CmdSweep "
+                "--device_delay 0.5 ms "
+                "--min_delay 0.5 ms {options}"
+                .format(nineml_model=self.izhi_path, sim=simulator,
+                        out_path=out_path, in_path=in_path,
+                        sweep_path=sweep_path, t_stop=self.t_stop,
+                        dt=self.dt, U='{} {}'.format(*self.U),
+                        rec_t_start='{} {}'.format(*self.rec_t_start),
+                        options=options))
+            simulate.run(argv.split())
+            v = neo.io.PickleIO(out_path).read()[0].analogsignals[0]
+            self.assertEqual(v.shape[1], len(init_vs))
+            # The row with the reference initial value should match the
+            # simulation of a single cell
+            ref_v = self._ref_single_cell(simulator, isyn)[0]
+            self.assertEqual(len(v), len(ref_v))
+            self.assertTrue(
+                np.allclose(np.asarray(v[:, 0].rescale(ref_v.units)).ravel(),
+                            np.asarray(ref_v).ravel(), atol=1e-6),
+                "Row of '{}' sweep ({}) with the reference initial value "
+                "produced different results to a single cell simulation "
+                "of the Izhikevich model".format(simulator, options.strip()))
+            self.assertGreater(float(v[:, 0].max()), -60.0)
+
     def _ref_single_cell(self, simulator, isyn):
         if simulator == 'neuron':
             metaclass = NeuronCellMetaClass
@@ -1,5 +1,6 @@
 from __future__ import division
 from __future__ import print_function
+import ctypes
 from itertools import chain
 import ninemlcatalog
 import numpy
@@ -12,6 +13,8 @@ from pype9.simulate.nest import (
     CellMetaClass as NESTCellMetaClass, Network as NESTNetwork,
     Simulation as NESTSimulation)
 from pype9.simulate.neuron import Simulation
+from pype9.simulate.neuron.code_gen import (
+    CodeGenerator as NeuronCodeGenerator)
 import pype9.utils.logging.handlers.sysout  # @UnusedImport
 if __name__ == '__main__':
     from pype9.utils.testing import DummyTestCase as TestCase  # @UnusedImport
@@ -126,6 +129,82 @@ class TestSeeding(TestCase):
                                     list(chain(*ext1_spikes.spiketrains)),
                                     list(chain(*ext4_spikes.spiketrains))))
 
+    def test_threaded_network_seed(self, num_threads=2):
+        brunel_model = self._load_brunel('AI', 1)
+        brunel_model.population('Ext').cell['rate'] = 300 / un.s
+        for Network, Simulation in (
+            (NeuronNetwork, NeuronSimulation),
+                (NESTNetwork, NESTSimulation)):
+            ext_spikes = []
+            for _ in range(2):
+                with Simulation(dt=0.01 * un.ms, seed=1,
+                                num_threads=num_threads) as sim:
+                    self.assertEqual(len(sim.all_dynamics_seeds),
+                                     sim.num_processes() * num_threads)
+                    network = Network(brunel_model)
+                    network.component_array('Ext').record('spike_output')
+                    sim.run(20 * un.ms)
+                ext_spikes.append(list(chain(*network.component_array(
+                    'Ext').recording('spike_output').spiketrains)))
+            self.assertEqual(ext_spikes[0], ext_spikes[1],
+                             "Threaded network spikes not the same despite "
+                             "using the same seed")
+
+    def test_batched_variates(self, n=256):
+        lib = ctypes.CDLL(NeuronCodeGenerator().libninemlnrn_so)
+        c_double_p = ctypes.POINTER(ctypes.c_double)
+        for prefix in ('nineml_gsl_', 'nineml_rng_'):
+            stream_args = ([] if prefix == 'nineml_gsl_'
+                           else [ctypes.c_double, c_double_p])
+            for dist, params in (('normal', 2), ('uniform', 2),
+                                 ('exponential', 1)):
+                scalar = getattr(lib, prefix + dist)
+                scalar.restype = ctypes.c_double
+                scalar.argtypes = stream_args + [ctypes.c_double] * params
+                fill = getattr(lib, prefix + 'fill_' + dist)
+                fill.restype = None
+                fill.argtypes = stream_args + [
+                    c_double_p, ctypes.c_size_t] + [ctypes.c_double] * params
+        params = {'normal': (1.0, 2.0), 'uniform': (-1.0, 3.0),
+                  'exponential': (0.5,)}
+        for dist, args in params.items():
+            # The scalar draws of the thread streams pop variates from
+            # buffers filled in batches from the same stream
+            lib.nineml_seed_gsl_rng(1)
+            scalars = [getattr(lib, 'nineml_gsl_' + dist)(*args)
+                       for _ in range(n)]
+            lib.nineml_seed_gsl_rng(1)
+            batch = (ctypes.c_double * n)()
+            getattr(lib, 'nineml_gsl_fill_' + dist)(batch, n, *args)
+            self.assertEqual(scalars, list(batch))
+            # Each scalar draw of an instance stream uses the first variate of
+            # a block, whereas batches use both variates of each block
+            scalar_counter = ctypes.c_double(0.0)
+            scalars = [getattr(lib, 'nineml_rng_' + dist)(
+                7.0, ctypes.byref(scalar_counter), *args) for _ in range(n)]
+            batch_counter = ctypes.c_double(0.0)
+            batch = (ctypes.c_double * (2 * n))()
+            getattr(lib, 'nineml_rng_fill_' + dist)(
+                7.0, ctypes.byref(batch_counter), batch, 2 * n, *args)
+            self.assertEqual(scalars, list(batch)[::2])
+            self.assertEqual(scalar_counter.value, batch_counter.value)
+            # Check the moments of a large batch
+            batch = (ctypes.c_double * 100000)()
+            getattr(lib, 'nineml_rng_fill_' + dist)(
+                8.0, ctypes.byref(batch_counter), batch, len(batch), *args)
+            batch = numpy.asarray(batch)
+            if dist == 'normal':
+                mean, std = args
+            elif dist == 'uniform':
+                mean = (args[0] + args[1]) / 2.0
+                std = (args[1] - args[0]) / numpy.sqrt(12.0)
+                self.assertTrue(numpy.all(batch >= args[0]) and
+                                numpy.all(batch < args[1]))
+            else:
+                mean = std = 1.0 / args[0]
+            self.assertAlmostEqual(batch.mean(), mean, delta=0.02 * std)
+            self.assertAlmostEqual(batch.std(), std, delta=0.02 * std)
+
     def _load_brunel(self, case, order):
         model = ninemlcatalog.load('network/Brunel2000/' + case).as_network(
             'Brunel_{}'.format(case))
@@ -3,17 +3,23 @@ from __future__ import print_function
 from __future__ import division
 from builtins import zip
 import sys
+import numpy
 import quantities as pq
+import neo
 from itertools import chain, repeat
 import logging
 import ninemlcatalog
 from nineml import units as un
 from nineml.user import Property
+from nineml.abstraction import (
+    Dynamics, Regime, OnCondition, OnEvent, StateVariable, Parameter,
+    EventSendPort, EventReceivePort, OutputEvent, StateAssignment)
 from nineml.user.multi.dynamics import MultiDynamics
 from nineml.user import DynamicsProperties
 from pype9.simulate.common.cells import (
-    MultiDynamicsWithSynapses, DynamicsWithSynapsesProperties,
-    ConnectionParameterSet, ConnectionPropertySet)
+    DynamicsWithSynapses, MultiDynamicsWithSynapses,
+    DynamicsWithSynapsesProperties, ConnectionParameterSet,
+    ConnectionPropertySet)
 from pype9.simulate.neuron import (
     CellMetaClass as NeuronCellMetaClass,
     Simulation as NeuronSimulation)
@@ -21,7 +27,9 @@ argv = sys.argv[1:]  # Save argv before it is clobbered by the NEST init.
 from pype9.simulate.nest import (  # @IgnorePep8
     CellMetaClass as NESTCellMetaClass,
     Simulation as NESTSimulation)
+import nest  # @IgnorePep8
 from pype9.utils.testing import Comparer, input_step, input_freq  # @IgnorePep8
+from pype9.exceptions import Pype9UsageError, Pype9BuildError  # @IgnorePep8
 from pype9.simulate.nest.units import UnitHandler as UnitHandlerNEST  # @IgnorePep8
 import pype9.utils.logging.handlers.sysout  # @IgnorePep8
 if __name__ == '__main__':
@@ -437,6 +445,458 @@ class TestDynamics(TestCase):
                      recorded_rate - ref_rate)))
 
 
+class TestBuildOptions(TestCase):
+    """
+    Tests of the behaviour of the optional code-generation features, which
+    mostly compare the traces of LIaF cells built with the feature against
+    those of the default build
+    """
+
+    dt = 0.1
+    duration = 100.0
+    build_mode = BUILD_MODE_DEFAULT
+    liaf_initial_states = TestDynamics.liaf_initial_states
+
+    def test_root_finding(self):
+        # A capacitor charging towards 'v_inf' crosses 'v_thresh' at
+        # -tau * ln(1 - v_thresh / v_inf), which isn't on the time grid
+        dt = 0.5
+        charging = Dynamics(
+            name='Charging',
+            parameters=[Parameter('tau', dimension=un.time),
+                        Parameter('v_inf', dimension=un.voltage),
+                        Parameter('v_thresh', dimension=un.voltage)],
+            state_variables=[StateVariable('v', dimension=un.voltage)],
+            event_ports=[EventSendPort('spike')],
+            regimes=[
+                Regime('dv/dt = (v_inf - v) / tau', name='charging',
+                       transitions=[OnCondition(
+                           'v > v_thresh', output_events=[
+                               OutputEvent('spike')],
+                           target_regime_name='saturated')]),
+                Regime('dv/dt = (v_inf - v) / tau', name='saturated')])
+        tau, v_inf, v_thresh = 10.0, 20.0, 15.0
+        crossing = -tau * numpy.log(1.0 - v_thresh / v_inf)
+        celltype = self._celltype(charging, 'RootFinding', root_finding=True)
+        with NESTSimulation(dt=dt * un.ms, seed=NEST_RNG_SEED) as sim:
+            cell = celltype(tau=tau * un.ms, v_inf=v_inf * un.mV,
+                            v_thresh=v_thresh * un.mV, v=0.0 * un.mV,
+                            regime_='charging')
+            cell.record('spike')
+            cell.record_regime()
+            sim.run(50.0 * un.ms)
+        # The logged time of the transition should be located within the step
+        # to the analytic crossing time
+        epochs = cell.regime_epochs()
+        self.assertEqual(list(epochs.labels), ['charging', 'saturated'])
+        self.assertAlmostEqual(float(epochs.times[1].rescale(pq.ms)),
+                               crossing, delta=0.01)
+        # The spike is emitted at the end of the step the crossing is in
+        spikes = cell.recording('spike')
+        self.assertEqual(len(spikes), 1)
+        self.assertAlmostEqual(float(spikes[0].rescale(pq.ms)),
+                               numpy.ceil(crossing / dt) * dt)
+
+    def test_regime_dispatch(self):
+        # Cycles through three regimes, transitioning every 'period'
+        period, duration = 2.0, 21.0
+        names = ['A', 'B', 'C']
+        cycle = Dynamics(
+            name='Cycle',
+            parameters=[Parameter('period', dimension=un.time)],
+            state_variables=[StateVariable('t_next', dimension=un.time)],
+            regimes=[
+                Regime(name=name, transitions=[OnCondition(
+                    't > t_next',
+                    state_assignments=[
+                        StateAssignment('t_next', 't + period')],
+                    target_regime_name=names[(i + 1) % len(names)])])
+                for i, name in enumerate(names)])
+        celltype = self._celltype(cycle, 'Dispatch')
+        with NESTSimulation(dt=self.dt * un.ms, seed=NEST_RNG_SEED) as sim:
+            # The cells are copied from the same prototype but start in
+            # different regimes
+            cells = [celltype(period=period * un.ms, t_next=period * un.ms,
+                              regime_=name) for name in names]
+            for cell in cells:
+                cell.record_regime()
+            sim.run(duration * un.ms)
+        num_transitions = int(duration // period)
+        for i, cell in enumerate(cells):
+            epochs = cell.regime_epochs()
+            self.assertEqual(
+                list(epochs.labels),
+                [names[(i + j) % len(names)]
+                 for j in range(num_transitions + 1)])
+            self.assertTrue(all(abs(
+                numpy.asarray(epochs.times[1:].rescale(pq.ms)) -
+                numpy.arange(1, num_transitions + 1) * period) < self.dt))
+
+    def test_batched(self, num_cells=3):
+        unbatched = self._liaf_cells(num_cells)
+        # The batch is simulated twice to check the batch is reset between
+        # simulations, with the last instance frozen
+        for _ in range(2):
+            batched = self._liaf_cells(num_cells, num_frozen=1, batched=True,
+                                       build_version='Batched')
+            for ref, cell in zip(unbatched[:-1], batched[:-1]):
+                self._assert_traces_match(ref, cell, 0.01)
+            # The frozen instance shouldn't be integrated
+            self.assertEqual(
+                float(batched[-1].v.in_units(un.mV)),
+                float(self.liaf_initial_states['v'].rescale(pq.mV)))
+
+    def test_batch_build(self):
+        liaf = ninemlcatalog.load('neuron/LeakyIntegrateAndFire',
+                                  'PyNNLeakyIntegrateAndFire')
+        izhi = ninemlcatalog.load('neuron/Izhikevich', 'Izhikevich')
+        izhi_properties = ninemlcatalog.load('neuron/Izhikevich',
+                                             'SampleIzhikevich')
+        izhi_initial_states = {'U': -14.0 * pq.mV / pq.ms,
+                               'V': -65.0 * pq.mV}
+        # Members of a batch are configured together so can't have
+        # conflicting build options
+        self.assertRaises(
+            Pype9BuildError, NESTCellMetaClass.build_batch,
+            [{'component_class': liaf, 'build_version': 'BatchConflict',
+              'ode_solver': 'gsl'},
+             {'component_class': izhi, 'build_version': 'BatchConflict',
+              'ode_solver': 'euler'}],
+            build_mode=self.build_mode)
+        # Build the two classes into a single module and check the member
+        # loaded from it behaves the same as the separately built class
+        batch = [{'component_class': liaf, 'build_version': 'BatchBuild'},
+                 {'component_class': izhi, 'build_version': 'BatchBuild'}]
+        NESTCellMetaClass.build_batch(batch, build_mode=self.build_mode)
+        ref = self._liaf_cells()[0]
+        cell = self._liaf_cells(build_version='BatchBuild')[0]
+        self.assertTrue(cell.code_generator.was_batch_built(
+            cell.build_component_class))
+        self._assert_traces_match(ref, cell, 1e-6)
+        # The other member is loaded from the same module
+        Izhikevich = NESTCellMetaClass(izhi, build_version='BatchBuild')
+        with NESTSimulation(dt=self.dt * un.ms, seed=NEST_RNG_SEED) as sim:
+            izhi_cell = Izhikevich(izhi_properties,
+                                   regime_='subthreshold_regime',
+                                   **izhi_initial_states)
+            izhi_cell.record('V')
+            sim.run(self.duration * un.ms)
+        self.assertEqual(len(izhi_cell.recording('V')),
+                         len(ref.recording('v')))
+        # The mechanisms of all the members of a NEURON batch are compiled
+        # into the same library
+        NeuronCellMetaClass.build_batch(batch, build_mode=self.build_mode)
+        LIaF = NeuronCellMetaClass(liaf, build_version='BatchBuild')
+        Izhikevich = NeuronCellMetaClass(izhi, build_version='BatchBuild')
+        with NeuronSimulation(dt=self.dt * un.ms,
+                              seed=NEURON_RNG_SEED) as sim:
+            cells = [
+                LIaF(ninemlcatalog.load(
+                    'neuron/LeakyIntegrateAndFire',
+                    'PyNNLeakyIntegrateAndFireProperties'),
+                    regime_='subthreshold', **self.liaf_initial_states),
+                Izhikevich(izhi_properties, regime_='subthreshold_regime',
+                           **izhi_initial_states)]
+            for cell, state in zip(cells, ('v', 'V')):
+                self.assertTrue(cell.code_generator.was_batch_built(
+                    cell.build_component_class))
+                cell.record(state)
+            sim.run(self.duration * un.ms)
+        recordings = [c.recording(s) for c, s in zip(cells, ('v', 'V'))]
+        self.assertTrue(len(recordings[0]))
+        self.assertEqual(len(recordings[0]), len(recordings[1]))
+
+    def test_exact_solver(self):
+        # With root-finding the propagators of the partial steps after the
+        # spikes are calculated separately from the cached full-step ones
+        for root_finding in (False, True):
+            suffix = 'Root' if root_finding else ''
+            ref = self._liaf_cells(root_finding=root_finding,
+                                   build_version=suffix or None)[0]
+            cell = self._liaf_cells(ode_solver='exact',
+                                    root_finding=root_finding,
+                                    build_version='Exact' + suffix)[0]
+            self._assert_traces_match(ref, cell, 0.01)
+
+    def test_gsl_steppers(self, num_cells=2):
+        ref = self._liaf_cells()[0]
+        # More than one instance is simulated so that the shared solver
+        # structures are alternated between them (and the multistep ones
+        # aren't)
+        for stepper in ('rkf45', 'msbdf'):
+            for cell in self._liaf_cells(num_cells, gsl_stepper=stepper,
+                                         build_version=stepper.capitalize()):
+                self._assert_traces_match(
+                    ref, cell, 0.01,
+                    "'{}' stepper trace did not match the default stepper's"
+                    .format(stepper))
+
+    def test_event_driven(self):
+        # The leaky integrator decays towards zero so only crosses its
+        # threshold when an input event pushes it over, in which case the
+        # transition should be applied at the time of the event
+        duration = 50.0
+        integrator = Dynamics(
+            name='LeakyIntegrator',
+            parameters=[Parameter('tau', dimension=un.time),
+                        Parameter('x_thresh', dimension=un.dimensionless),
+                        Parameter('weight', dimension=un.dimensionless)],
+            state_variables=[StateVariable('x', dimension=un.dimensionless)],
+            event_ports=[EventReceivePort('input'), EventSendPort('spike')],
+            regimes=[
+                Regime('dx/dt = -x / tau', name='integrating',
+                       transitions=[
+                           OnEvent('input', state_assignments=[
+                               StateAssignment('x', 'x + weight')]),
+                           OnCondition('x > x_thresh', output_events=[
+                               OutputEvent('spike')], state_assignments=[
+                               StateAssignment('x', '0')])])])
+        integrator_with_syn = DynamicsWithSynapses(
+            'LeakyIntegratorWithSyn', integrator,
+            connection_parameter_sets=[ConnectionParameterSet(
+                'input', [integrator.parameter('weight')])])
+        celltype = self._celltype(integrator_with_syn, 'EventDriven',
+                                  metaclass=NeuronCellMetaClass,
+                                  event_driven=True)
+        # The second input pushes x to 0.6 * exp(-0.2) + 0.6 > 1 whereas the
+        # third one only takes it to 0.6
+        input_times = [10.0, 12.0, 30.0]
+        with NeuronSimulation(dt=self.dt * un.ms,
+                              seed=NEURON_RNG_SEED) as sim:
+            cell = celltype(tau=10.0 * un.ms, x_thresh=1.0 * un.unitless,
+                            x=0.0 * un.unitless, regime_='integrating')
+            cell.play('input', neo.SpikeTrain(input_times, t_stop=duration,
+                                              units='ms'),
+                      properties=[Property('weight', 0.6 * un.unitless)])
+            cell.record('spike')
+            sim.run(duration * un.ms)
+        spikes = cell.recording('spike')
+        self.assertEqual(len(spikes), 1)
+        self.assertAlmostEqual(float(spikes[0].rescale(pq.ms)),
+                               input_times[1], delta=self.dt)
+
+    def test_summed_events(self):
+        # The OnEvent is linear in the weight so the weights of the events
+        # received in the same step are summed and applied once
+        duration = 20.0
+        accumulator_with_syn = self._accumulator('Accumulator')
+        celltype = self._celltype(accumulator_with_syn, 'Summed')
+        weight = Property('weight', 2.0 * un.nA)
+        spike_times = [5.0, 10.0, 10.0, 10.0, 15.0]
+        with NESTSimulation(dt=self.dt * un.ms, seed=NEST_RNG_SEED) as sim:
+            cell = celltype(a=0.0 * un.nA)
+            cell.play('spike', neo.SpikeTrain(spike_times, t_stop=duration,
+                                              units='ms'),
+                      properties=[weight])
+            cell.record('a')
+            sim.run(duration * un.ms)
+        a = cell.recording('a')
+        # Each of the simultaneous events should be counted
+        self.assertAlmostEqual(
+            float(a[int(round(12.0 / self.dt))].rescale(pq.nA)), 8.0)
+        self.assertAlmostEqual(float(cell.a.in_units(un.nA)),
+                               2.0 * len(spike_times))
+
+    def test_constant_parameters(self):
+        # Compiling parameters into the model as constants shouldn't change
+        # its behaviour when they are given the values of its properties
+        properties = ninemlcatalog.load(
+            'neuron/LeakyIntegrateAndFire',
+            'PyNNLeakyIntegrateAndFireProperties')
+        constants = dict((n, properties.property(n).quantity)
+                         for n in ('tau_m', 'tau_refrac'))
+        ref = self._liaf_cells()[0]
+        cell = self._liaf_cells(constant_parameters=constants,
+                                build_version='Constant')[0]
+        self._assert_traces_match(ref, cell, 1e-6)
+        self.assertRaises(
+            Pype9BuildError, self._celltype,
+            ninemlcatalog.load('neuron/LeakyIntegrateAndFire',
+                               'PyNNLeakyIntegrateAndFire'),
+            'ConstantUnknown', constant_parameters={'not_a_parameter': 1.0})
+        # Connection parameters vary between connections
+        self.assertRaises(
+            Pype9BuildError, self._celltype,
+            self._accumulator('ConstAccumulator'), None,
+            constant_parameters={'weight': 1.0})
+
+    def test_alias_cache(self):
+        # The cached gating rates of the HH channels (which only depend on v)
+        # should only be reused while v is unchanged, so caching shouldn't
+        # change the trace
+        dt = 0.01
+        hh = ninemlcatalog.load('neuron/HodgkinHuxley', 'PyNNHodgkinHuxley')
+        properties = ninemlcatalog.load('neuron/HodgkinHuxley',
+                                        'PyNNHodgkinHuxleyProperties')
+        traces = []
+        for alias_cache in (False, True):
+            celltype = self._celltype(
+                hh, 'AliasCache{}'.format(int(alias_cache)),
+                alias_cache=alias_cache)
+            with NESTSimulation(dt=dt * un.ms, seed=NEST_RNG_SEED) as sim:
+                cell = celltype(properties, regime_=next(hh.regimes).name,
+                                v=-65.0 * pq.mV, m=0.0, h=1.0, n=0.0)
+                cell.play(*input_step('iExt', 0.5, 50, 100, dt, 10))
+                cell.record('v')
+                sim.run(self.duration * un.ms)
+            traces.append(numpy.asarray(cell.recording('v').rescale(pq.mV)))
+        # Check the input elicits action potentials
+        self.assertGreater(traces[1].max(), 0.0)
+        self.assertLess(abs(traces[0] - traces[1]).max(), 1e-6)
+
+    def test_analytic_jacobian(self):
+        # The implicit steppers should produce the same Izhikevich trace (which
+        # depends nonlinearly on V) whether their Jacobian is generated
+        # analytically or approximated by finite differences
+        izhi = ninemlcatalog.load('neuron/Izhikevich', 'Izhikevich')
+        properties = ninemlcatalog.load('neuron/Izhikevich',
+                                        'SampleIzhikevich')
+        traces = {}
+        for stepper, analytic in (('rk2', False), ('bsimp', False),
+                                  ('bsimp', True)):
+            celltype = self._celltype(
+                izhi, 'Jac{}{}'.format(stepper.capitalize(), int(analytic)),
+                gsl_stepper=stepper, analytic_jacobian=analytic)
+            with NESTSimulation(dt=self.dt * un.ms,
+                                seed=NEST_RNG_SEED) as sim:
+                cell = celltype(properties, regime_='subthreshold_regime',
+                                U=-14.0 * pq.mV / pq.ms, V=-65.0 * pq.mV)
+                cell.play(*input_step('Isyn', 0.02, 50, 100, self.dt, 30))
+                cell.record('V')
+                sim.run(self.duration * un.ms)
+            traces[(stepper, analytic)] = numpy.asarray(cell.recording('V'))
+        ref = traces.pop(('rk2', False))
+        for (stepper, analytic), trace in traces.items():
+            self.assertLess(
+                abs(ref - trace).mean(), 0.1,
+                "'{}' stepper with {} Jacobian did not match 'rk2' trace"
+                .format(stepper, 'analytic' if analytic else 'approximate'))
+
+    def test_steady_state(self):
+        # The steady state of v is v_inf for any (non-zero) rate
+        relaxation = Dynamics(
+            name='Relaxation',
+            parameters=[Parameter('rate', dimension=un.per_time),
+                        Parameter('v_inf', dimension=un.voltage)],
+            state_variables=[StateVariable('v', dimension=un.voltage)],
+            regimes=[Regime('dv/dt = rate * (v_inf - v)', name='default')])
+        celltype = self._celltype(relaxation, 'SteadyState', ss_solver='gsl')
+        with NESTSimulation(dt=self.dt * un.ms, seed=NEST_RNG_SEED):
+            ids = nest.Create(celltype.name, 3)
+            # The states are reinitialised from the parameters of the
+            # prototype, the first from a solve and the rest from the cache,
+            # then from a solve warm-started from the cached solution
+            for v_inf in (20.0, 30.0, 20.0):
+                nest.SetDefaults(celltype.name, {'rate': 0.1,
+                                                 'v_inf': v_inf})
+                nest.ResetNetwork()
+                for v in nest.GetStatus(ids, 'v'):
+                    self.assertAlmostEqual(v, v_inf, places=5)
+
+    def test_counters(self):
+        cell = self._liaf_cells(instrument=True,
+                                build_version='Instrumented')[0]
+        counters = cell.counters
+        self.assertGreater(counters['ode_steps'], 0)
+        # The step current drives the cell over threshold
+        self.assertGreater(counters['transitions']['subthreshold'], 0)
+        cell.reset_counters()
+        self.assertEqual(cell.counters['ode_steps'], 0)
+        self.assertEqual(cell.counters['transitions']['subthreshold'], 0)
+        # Cells that aren't instrumented don't have counters
+        uninstrumented = self._liaf_cells()[0]
+        self.assertRaises(Pype9UsageError, getattr, uninstrumented,
+                          'counters')
+        self.assertRaises(Pype9UsageError, uninstrumented.reset_counters)
+
+    def test_regime_log(self):
+        logged, sampled = (
+            self._liaf_cells(regime_log=regime_log, record_regime=True,
+                             build_version=('RegimeLog' if regime_log
+                                            else 'NoRegimeLog'))[0]
+            for regime_log in (True, False))
+        # The regime is recorded at the default interval whether or not it is
+        # also logged by the cell
+        for cell in (logged, sampled):
+            self.assertEqual(
+                len(cell._regime_recording()),
+                len(cell.recording('v')))
+        # The epochs from the logged regime changes should match those derived
+        # from the regime sampled every step
+        logged, sampled = logged.regime_epochs(), sampled.regime_epochs()
+        self.assertGreater(len(logged), 1)
+        self.assertEqual(list(logged.labels), list(sampled.labels))
+        self.assertTrue(all(
+            abs(logged.times - sampled.times) <= self.dt * pq.ms))
+
+    def _celltype(self, component_class, build_version,
+                  metaclass=NESTCellMetaClass, **build_args):
+        """
+        Builds the cell class of the component class with the build mode of
+        the tests
+        """
+        return metaclass(component_class, build_mode=self.build_mode,
+                         build_version=build_version, **build_args)
+
+    def _liaf_cells(self, num_cells=1, num_frozen=0, record_regime=False,
+                    build_version=None, **build_args):
+        """
+        Simulates LIaF cells driven by a step current with the NEST cell
+        class built with the given arguments and returns the cells with their
+        membrane voltages (and regimes if 'record_regime') recorded. The last
+        'num_frozen' cells are frozen.
+        """
+        celltype = self._celltype(
+            ninemlcatalog.load('neuron/LeakyIntegrateAndFire',
+                               'PyNNLeakyIntegrateAndFire'),
+            build_version, **build_args)
+        properties = ninemlcatalog.load(
+            'neuron/LeakyIntegrateAndFire',
+            'PyNNLeakyIntegrateAndFireProperties')
+        with NESTSimulation(dt=self.dt * un.ms, seed=NEST_RNG_SEED) as sim:
+            cells = []
+            for i in range(num_cells):
+                cell = celltype(properties, regime_='subthreshold',
+                                **self.liaf_initial_states)
+                cell.play(*input_step('i_synaptic', 1, 50, 100, self.dt, 20))
+                cell.record('v')
+                if record_regime:
+                    cell.record_regime()
+                if i >= num_cells - num_frozen:
+                    nest.SetStatus(cell._cell, {'frozen': True})
+                cells.append(cell)
+            sim.run(self.duration * un.ms)
+        return cells
+
+    def _assert_traces_match(self, ref, cell, tolerance, msg=None):
+        """
+        Asserts the mean difference between the recorded membrane voltages of
+        the two cells is less than the tolerance
+        """
+        diff = abs(numpy.asarray(ref.recording('v')) -
+                   numpy.asarray(cell.recording('v')))
+        self.assertLess(diff.mean(), tolerance, msg)
+
+    @staticmethod
+    def _accumulator(name):
+        """
+        An accumulator of the weights of the events it receives, which is a
+        connection parameter
+        """
+        accumulator = Dynamics(
+            name=name,
+            parameters=[Parameter('weight', dimension=un.current)],
+            state_variables=[StateVariable('a', dimension=un.current)],
+            event_ports=[EventReceivePort('spike')],
+            regimes=[Regime(name='default', transitions=[
+                OnEvent('spike', state_assignments=[
+                    StateAssignment('a', 'a + weight')])])])
+        return DynamicsWithSynapses(
+            name + 'WithSyn', accumulator,
+            connection_parameter_sets=[ConnectionParameterSet(
+                'spike', [accumulator.parameter('weight')])])
+
+
 if __name__ == '__main__':
     import argparse
     parser = argparse.ArgumentParser()
@@ -33,11 +33,16 @@ from pype9.simulate.neuron.network import Network as NeuronPype9Network
 from pype9.simulate.neuron import Simulation as NeuronSimulation
 import ninemlcatalog
 import sys
+import tempfile
+import shutil
+import os.path
 argv = sys.argv[1:]  # Save argv before it is clobbered by the NEST init.
 import nest  # @IgnorePep8
 from pype9.simulate.nest.network import Network as NestPype9Network  # @IgnorePep8
 from pype9.simulate.nest import Simulation as NESTSimulation  # @IgnorePep8
 from pype9.utils.testing import ReferenceBrunel2000  # @IgnorePep8
+from pype9.simulate.common.recording import (  # @IgnorePep8
+    StreamedRecording, StreamedSpikeInput)
 import pype9.utils.logging.handlers.sysout  # @IgnorePep8
 
 try:
@@ -160,6 +165,24 @@ class TestBrunel2000(TestCase):
                         else:
                             pass
 
+    def test_bulk_states(self, case='AI', order=10, **kwargs):  # @UnusedVariable @IgnorePep8
+        for sim_name, simulation in self.simulations.items():
+            with simulation:
+                nml = self._construct_nineml(case, order, sim_name)
+                exc = nml.component_array('Exc')
+                states = exc.get_states(['v__cell', 'tau__cell'])
+                self.assertEqual(len(states), len(exc.local_cells))
+                states['v__cell'] = numpy.linspace(-10.0, 10.0, len(states))
+                exc.set_states(states)
+                self.assertTrue(numpy.allclose(
+                    exc.get_states(['v__cell'])['v__cell'],
+                    states['v__cell']))
+                # Quantities are converted to the units of the simulator
+                exc.set_states({'v__cell': states['v__cell'] * 1e-3 * pq.V})
+                self.assertTrue(numpy.allclose(
+                    exc.get_states(['v__cell'])['v__cell'],
+                    states['v__cell']))
+
     def test_connection_degrees(self, case='AI', order=500, **kwargs):  # @UnusedVariable @IgnorePep8
         """
         Compares the in/out degree of all projections in the 9ML network with
@@ -255,6 +278,47 @@ class TestBrunel2000(TestCase):
                              .format(attr, ref_stdev, nml_stdev,
                                      conn_group.name)))
 
+    def test_save_load_connections(self, case='AI', order=10, **kwargs):  # @UnusedVariable @IgnorePep8
+        conns = {}
+        tmp_dir = tempfile.mkdtemp()
+        try:
+            for load_connections in (None, tmp_dir):
+                with self.simulations['nest']:
+                    nml = self._construct_nineml(
+                        case, order, 'nest', load_connections=load_connections)
+                    if load_connections is None:
+                        nml.save_connections(tmp_dir, format='npy')
+                    conns[load_connections] = dict(
+                        (cg.name, sorted(
+                            tuple(c) for c in cg.get(
+                                ['weight', 'delay'], 'list', gather=False)))
+                        for cg in nml.connection_groups)
+        finally:
+            shutil.rmtree(tmp_dir)
+        self.assertEqual(conns[None], conns[tmp_dir])
+
+    def test_connectivity_replay(self, case='AI', order=10, **kwargs):  # @UnusedVariable @IgnorePep8
+        with self.simulations['nest']:
+            nml = self._construct_nineml(case, order, 'nest')
+            for conn_group in nml.connection_groups:
+                original = self._local_connections(conn_group)
+                self.assertTrue(original)
+                # The sampled connections are stored in CSR format by the
+                # connectivity
+                self.assertEqual(sorted(conn_group.connectivity.connections()),
+                                 original)
+                # Connection groups constructed with the same (already
+                # sampled) connectivity replay them
+                replayed = type(conn_group)(
+                    conn_group._nineml, source=conn_group.pre,
+                    destination=conn_group.post)
+                self.assertEqual(self._local_connections(replayed), original)
+
+    @classmethod
+    def _local_connections(cls, conn_group):
+        return sorted((int(src), int(dest)) for src, dest, _ in conn_group.get(
+            ['weight'], 'list', gather=False, with_address=True))
+
     def test_sizes(self, case='AI', order=100, **kwargs):  # @UnusedVariable @IgnorePep8
         with self.simulations['nest']:
             nml_network = self._construct_nineml(case, order, 'nest')
@@ -279,6 +343,115 @@ class TestBrunel2000(TestCase):
                     "reference ({})".format(conn_group.name, nml_size,
                                             ref_size))
 
+    def test_streamed_recording(self, case='AI', order=10, simtime=100.0,
+                                **kwargs):  # @UnusedVariable
+        tmp_dir = tempfile.mkdtemp()
+        try:
+            with NESTSimulation(
+                    dt=self.timestep * un.ms, seed=NEST_RNG_SEED,
+                    min_delay=ReferenceBrunel2000.min_delay,
+                    max_delay=ReferenceBrunel2000.max_delay,
+                    stream_recordings=tmp_dir,
+                    stream_interval=simtime / 4 * un.ms) as sim:
+                nml = self._construct_nineml(case, order, 'nest')
+                exc = nml.component_array('Exc')
+                exc.record('spike_output')
+                exc.record('v__cell')
+                sim.run(simtime * un.ms)
+            streamed = StreamedRecording(tmp_dir)
+            v = streamed.analog_signal('Exc', 'v__cell')
+            self.assertEqual(v.shape[1], exc.size)
+            self.assertAlmostEqual(
+                float(v.t_stop.rescale(pq.ms)), simtime, delta=self.timestep)
+            half = streamed.analog_signal('Exc', 'v__cell',
+                                          t_start=simtime / 2, indices=[0])
+            self.assertEqual(half.shape[1], 1)
+            self.assertTrue(numpy.allclose(
+                half.magnitude[:, 0], v.magnitude[-len(half):, 0]))
+            for st in streamed.spike_trains('Exc', t_stop=simtime / 2):
+                self.assertTrue(all(st < simtime / 2 * pq.ms))
+        finally:
+            shutil.rmtree(tmp_dir)
+
+    def test_streamed_input(self, case='AI', order=10, simtime=100.0,
+                            **kwargs):  # @UnusedVariable
+        mean_isi = 1000.0 / ReferenceBrunel2000.parameters(case, order)[-1]
+        external_input = []
+        for _ in range(order * 5):
+            spike_times = numpy.cumsum(numpy.random.exponential(
+                mean_isi, int(numpy.floor(1.5 * simtime / mean_isi))))
+            spike_times = spike_times[numpy.logical_and(
+                spike_times < simtime,
+                spike_times > ReferenceBrunel2000.min_delay + self.timestep)]
+            external_input.append(
+                neo.SpikeTrain(spike_times, units='ms',
+                               t_stop=simtime * pq.ms))
+        tmp_dir = tempfile.mkdtemp()
+        try:
+            streamed_input = StreamedSpikeInput.write(
+                os.path.join(tmp_dir, 'input.bin'), external_input)
+            self.assertEqual(len(streamed_input),
+                             sum(len(st) for st in external_input))
+            recordings = []
+            for signal, interval in ((external_input, None),
+                                     (streamed_input, simtime / 7 * un.ms)):
+                with NESTSimulation(
+                        dt=self.timestep * un.ms, seed=NEST_RNG_SEED,
+                        min_delay=ReferenceBrunel2000.min_delay,
+                        max_delay=ReferenceBrunel2000.max_delay,
+                        stream_interval=interval) as sim:
+                    nml = self._construct_nineml(case, order, 'nest',
+                                                 external_input=signal)
+                    nml.component_array('Exc').record('v__cell')
+                    sim.run(simtime * un.ms)
+                recordings.append(nml.component_array('Exc').recording(
+                    'v__cell').analogsignals[0])
+        finally:
+            shutil.rmtree(tmp_dir)
+        self.assertTrue(numpy.allclose(recordings[0].magnitude,
+                                       recordings[1].magnitude))
+
+    def test_balanced_placement(self, case='AI', order=10, **kwargs):  # @UnusedVariable @IgnorePep8
+        with self.simulations['neuron']:
+            nml = self._construct_nineml(
+                case, order, 'neuron', placement='balanced',
+                cell_costs={'Exc': 2.0})
+            report = nml.placement_report()
+            self.assertEqual(len(report['cells']),
+                             self.simulations['neuron'].num_processes())
+            self.assertEqual(
+                sum(sum(c.values()) for c in report['cells']),
+                sum(a.size for a in nml.component_arrays))
+            # The cost of each process is within the cost of a single (Exc)
+            # cell of the mean
+            self.assertLessEqual(
+                max(report['costs']) - min(report['costs']), 2 * 2.0)
+
+    def test_checkpoint_restore(self, case='AI', order=10, simtime=50.0,
+                                **kwargs):  # @UnusedVariable
+        tmp_dir = tempfile.mkdtemp()
+        try:
+            with self.simulations['nest'] as sim:
+                nml = self._construct_nineml(case, order, 'nest')
+                sim.run(simtime * un.ms)
+                sim.checkpoint(tmp_dir, networks=[nml])
+                checkpointed = nml.component_array('Exc').get_checkpoint()
+            with self.simulations['nest'] as sim:
+                nml = self._construct_nineml(
+                    case, order, 'nest', load_connections=os.path.join(
+                        tmp_dir, 'connections', nml.nineml.name))
+                sim.restore(tmp_dir)
+                sim.run(self.timestep * un.ms)
+                restored = nml.component_array('Exc').get_checkpoint()
+        finally:
+            shutil.rmtree(tmp_dir)
+        self.assertTrue(numpy.array_equal(checkpointed['regimes'],
+                                          restored['regimes']))
+        # The states have advanced by a single timestep since the restore
+        self.assertTrue(numpy.allclose(
+            checkpointed['states']['v__cell'], restored['states']['v__cell'],
+            atol=1.0))
+
     def test_activity(self, case='AI', order=50, simtime=250.0, plot=False,
                       record_size=50, record_pops=('Exc', 'Inh', 'Ext'),
                       record_states=False, record_start=0.0, bin_width=4.0,